@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <assert.h>
+#include <time.h>
 
 #include "mu-mips.h"
 
@@ -31,6 +32,7 @@ void help() {
 	printf("\t**********MU-MIPS Help MENU**********\n\n");
 	printf("sim\t-- simulate program to completion \n");
 	printf("run <n>\t-- simulate program for <n> instructions\n");
+	printf("fast <n>\t-- run <n> instructions quietly on the threaded engine (0 = to completion)\n");
 	printf("rdump\t-- dump register values\n");
 	printf("reset\t-- clears all registers/memory and re-loads the program\n");
 	printf("input <reg> <val>\t-- set GPR <reg> to <val>\n");
@@ -68,6 +70,15 @@ void mem_write_32(uint32_t address, uint32_t value)
 {
 	int i;
 	uint32_t offset;
+
+	/* drop translations of the program words this store overwrites */
+	if ( (address - MEM_TEXT_BEGIN) >> 2 < THREADED_SIZE ) {
+		THREADED_CODE[(address - MEM_TEXT_BEGIN) >> 2].op = THREADED_TRANSLATE;
+	}
+	if ( (address + 3 - MEM_TEXT_BEGIN) >> 2 < THREADED_SIZE ) {
+		THREADED_CODE[(address + 3 - MEM_TEXT_BEGIN) >> 2].op = THREADED_TRANSLATE;
+	}
+
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
 			offset = address - MEM_REGIONS[i].begin;
@@ -243,6 +254,13 @@ void handle_command() {
 		case 'p':
 			print_program(); 
 			break;
+		case 'F':
+		case 'f':
+			if (scanf("%u", &cycles) != 1) {
+				break;
+			}
+			fast_forward(cycles);
+			break;
 		default:
 			printf("Invalid Command.\n");
 			break;
@@ -315,6 +333,17 @@ void load_program() {
 	PROGRAM_SIZE = i/4;
 	printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
 	fclose(fp);
+
+	/* fresh translation slots for the threaded engine */
+	free(THREADED_CODE);
+	THREADED_SIZE = 0;
+	THREADED_CODE = calloc(PROGRAM_SIZE ? PROGRAM_SIZE : 1, sizeof(ThreadedIns));
+	if (THREADED_CODE == NULL) {
+		printf("Error: Can't allocate translation for %d words\n", PROGRAM_SIZE);
+		exit(-1);
+	}
+	THREADED_SIZE = PROGRAM_SIZE;
+	THREADED_FRESH = 1;
 }
 
 /************************************************************/
@@ -821,6 +850,279 @@ void handle_instruction()
 
 }
 
+/************************************************************/
+/* Threaded-code engine: execute up to max_ins instructions (0 = until SYSCALL)  */
+/* without printing. Each text word is translated once into a ThreadedIns       */
+/* holding its operands and the address of its handler label, and every        */
+/* handler ends in its own indirect jump to the next one. Results match         */
+/* handle_instruction(), so the two can be interleaved freely.                  */
+/************************************************************/
+uint32_t run_threaded( uint32_t max_ins )
+{
+#if defined(__GNUC__)
+	ThreadedIns *code = THREADED_CODE;
+	uint32_t size = THREADED_SIZE;
+	uint32_t limit = ( max_ins == 0 ) ? 0xFFFFFFFF : max_ins;
+	uint32_t count = 0;
+	uint32_t pc = CURRENT_STATE.PC;
+	uint32_t HI = CURRENT_STATE.HI, LO = CURRENT_STATE.LO;
+	uint32_t prev = prevInstruction;
+	uint32_t R[MIPS_REGS];
+	uint32_t idx, ins, oc, func, im, target;
+	ThreadedIns scratch, *ip;
+
+	if( RUN_FLAG == FALSE )
+	{
+		return 0;
+	}
+
+	//stores into text reset a slot to this label
+	THREADED_TRANSLATE = &&translate;
+	if( THREADED_FRESH )
+	{
+		for( idx = 0; idx < size; idx++ )
+		{
+			code[idx].op = &&translate;
+		}
+		THREADED_FRESH = 0;
+	}
+
+	memcpy( R, CURRENT_STATE.REGS, sizeof( R ) );
+
+//retire the current instruction and jump straight into the next one's handler
+#define NEXT( target ) \
+	do { \
+		pc = ( target ); \
+		if( ++count == limit ) goto out; \
+		idx = ( pc - MEM_TEXT_BEGIN ) >> 2; \
+		if( idx >= size || ( pc & 0x3 ) ) goto offcode; \
+		ip = &code[idx]; \
+		goto *ip->op; \
+	} while( 0 )
+
+//R-type handlers also remember func for the MULT/DIV hazard check
+#define NEXT_R() \
+	do { \
+		prev = ip->func; \
+		NEXT( pc + 4 ); \
+	} while( 0 )
+
+	idx = ( pc - MEM_TEXT_BEGIN ) >> 2;
+	if( idx < size && !( pc & 0x3 ) )
+	{
+		ip = &code[idx];
+		goto *ip->op;
+	}
+
+offcode:
+	//outside the loaded program: decode into a scratch slot every time
+	ip = &scratch;
+
+translate:
+	ins = mem_read_32( pc );
+	oc = ( 0xFC000000 & ins );
+	func = ( 0x0000003F & ins );
+	im = ( 0x0000FFFF & ins );
+	ip->rs = ( 0x03E00000 & ins ) >> 21;
+	ip->rt = ( 0x001F0000 & ins ) >> 16;
+	ip->rd = ( 0x0000F800 & ins ) >> 11;
+	ip->sa = ( 0x000007C0 & ins ) >> 6;
+	ip->func = func;
+	ip->imm = extend_sign( im );
+	ip->op = &&op_nop;
+
+	switch( oc )
+	{
+		//R-Type
+		case 0x00000000:
+			ip->op = &&op_rnop;
+			switch( func )
+			{
+				case 0x00000020: ip->op = &&op_add; break;
+				case 0x00000021: ip->op = &&op_add; break;
+				case 0x00000022: ip->op = &&op_sub; break;
+				case 0x00000023: ip->op = &&op_sub; break;
+				case 0x00000018: ip->op = &&op_mult; break;
+				case 0x00000019: ip->op = &&op_mult; break;
+				case 0x0000001A: ip->op = &&op_div; break;
+				case 0x0000001B: ip->op = &&op_div; break;
+				case 0x00000024: ip->op = &&op_and; break;
+				case 0x00000025: ip->op = &&op_or; break;
+				case 0x00000026: ip->op = &&op_xor; break;
+				case 0x00000027: ip->op = &&op_nor; break;
+				case 0x0000002A: ip->op = &&op_slt; break;
+				case 0x00000000: ip->op = &&op_sll; break;
+				case 0x00000002: ip->op = &&op_srl; break;
+				//handle_instruction's SRA never sees its sign test pass
+				case 0x00000003: ip->op = &&op_srl; break;
+				case 0x0000000C: ip->op = &&op_syscall; break;
+				case 0x00000008: ip->op = &&op_jr; break;
+				case 0x00000009: ip->op = &&op_jalr; break;
+				case 0x00000013: ip->op = &&op_mtlo; break;
+				case 0x00000011: ip->op = &&op_mthi; break;
+				//MFLO/MFHI write CURRENT_STATE, which cycle() then overwrites
+			}
+			break;
+
+		case 0x08000000:
+			ip->op = &&op_j;
+			ip->imm = ( pc & 0xF0000000 ) | ( ( 0x03FFFFFF & ins ) << 2 );
+			break;
+		case 0x0C000000:
+			ip->op = &&op_jal;
+			ip->imm = ( pc & 0xF0000000 ) | ( ( 0x03FFFFFF & ins ) << 2 );
+			break;
+
+		case 0x20000000: ip->op = &&op_addi; break;
+		case 0x24000000: ip->op = &&op_addi; break;
+		case 0xAC000000: ip->op = &&op_sw; break;
+		case 0xA4000000: ip->op = &&op_sw; break;
+		case 0x8C000000: ip->op = &&op_lw; break;
+		case 0x80000000: ip->op = &&op_lb; break;
+		case 0x84000000: ip->op = &&op_lh; break;
+		case 0x30000000: ip->op = &&op_andi; ip->imm = im; break;
+		case 0x38000000: ip->op = &&op_xori; ip->imm = im; break;
+		case 0x34000000: ip->op = &&op_ori; ip->imm = im; break;
+		case 0x3C000000: ip->op = &&op_lui; ip->imm = im << 16; break;
+
+		//branch offsets are taken from the branch itself
+		case 0x10000000: ip->op = &&op_beq; ip->imm = extend_sign( im ) << 2; break;
+		case 0x14000000: ip->op = &&op_bne; ip->imm = extend_sign( im ) << 2; break;
+		case 0x18000000: ip->op = &&op_blez; ip->imm = extend_sign( im ) << 2; break;
+		case 0x1C000000: ip->op = &&op_bgtz; ip->imm = extend_sign( im ) << 2; break;
+		case 0x04000000:
+			ip->imm = extend_sign( im ) << 2;
+			//BLTZ falls through into BGEZ in handle_instruction, so it always branches
+			if( ip->rt == 0 )
+				ip->op = &&op_b;
+			else if( ip->rt == 1 )
+				ip->op = &&op_bgez;
+			break;
+	}
+	goto *ip->op;
+
+op_add:	R[ip->rd] = R[ip->rs] + R[ip->rt]; NEXT_R();
+op_sub:	R[ip->rd] = R[ip->rs] - R[ip->rt]; NEXT_R();
+op_and:	R[ip->rd] = R[ip->rs] & R[ip->rt]; NEXT_R();
+op_or:	R[ip->rd] = R[ip->rs] | R[ip->rt]; NEXT_R();
+op_xor:	R[ip->rd] = R[ip->rs] ^ R[ip->rt]; NEXT_R();
+op_nor:	R[ip->rd] = ~( R[ip->rs] | R[ip->rt] ); NEXT_R();
+op_slt:	R[ip->rd] = ( R[ip->rs] < R[ip->rt] ) ? 0x00000001 : 0x00000000; NEXT_R();
+op_sll:	R[ip->rd] = R[ip->rt] << ip->sa; NEXT_R();
+op_srl:	R[ip->rd] = R[ip->rt] >> ip->sa; NEXT_R();
+op_mtlo:	LO = R[ip->rs]; NEXT_R();
+op_mthi:	HI = R[ip->rs]; NEXT_R();
+op_rnop:	NEXT_R();
+
+op_mult:
+	//32-bit product, so HI always ends up 0
+	if( prev != 0x0000012 && prev != 0x0000011 )
+	{
+		LO = R[ip->rs] * R[ip->rt];
+		HI = 0;
+	}
+	NEXT_R();
+
+op_div:
+	if( prev != 0x0000012 && prev != 0x0000011 && R[ip->rt] != 0 )
+	{
+		LO = R[ip->rs] / R[ip->rt];
+		HI = R[ip->rs] % R[ip->rt];
+	}
+	NEXT_R();
+
+op_syscall:
+	R[0] = 0xA;
+	RUN_FLAG = FALSE;
+	prev = ip->func;
+	pc += 4;
+	++count;
+	goto out;
+
+op_jr:
+	prev = ip->func;
+	NEXT( R[ip->rs] );
+
+op_jalr:
+	prev = ip->func;
+	target = R[ip->rs];
+	R[ip->rd] = pc + 0x8;
+	NEXT( target );
+
+op_j:	NEXT( ip->imm );
+op_jal:	R[31] = pc + 0x8; NEXT( ip->imm );
+
+op_addi:	R[ip->rt] = ip->imm + R[ip->rs]; NEXT( pc + 4 );
+op_andi:	R[ip->rt] = ip->imm & R[ip->rs]; NEXT( pc + 4 );
+op_xori:	R[ip->rt] = ip->imm ^ R[ip->rs]; NEXT( pc + 4 );
+op_ori:	R[ip->rt] = ip->imm | R[ip->rs]; NEXT( pc + 4 );
+op_lui:	R[ip->rt] = ip->imm; NEXT( pc + 4 );
+
+op_sw:	mem_write_32( ip->imm + R[ip->rs], R[ip->rt] ); NEXT( pc + 4 );
+op_lw:	R[ip->rt] = mem_read_32( ip->imm + R[ip->rs] ); NEXT( pc + 4 );
+op_lb:	R[ip->rt] = 0x0000000F | mem_read_32( ip->imm + R[ip->rs] ); NEXT( pc + 4 );
+op_lh:	R[ip->rt] = 0x000000FF | mem_read_32( ip->imm + R[ip->rs] ); NEXT( pc + 4 );
+
+op_beq:	NEXT( pc + ( ( R[ip->rs] == R[ip->rt] ) ? ip->imm : 4 ) );
+op_bne:	NEXT( pc + ( ( R[ip->rs] != R[ip->rt] ) ? ip->imm : 4 ) );
+op_blez:	NEXT( pc + ( ( ( R[ip->rs] & 0x80000000 ) || ( R[ip->rt] == 0 ) ) ? ip->imm : 4 ) );
+op_bgtz:	NEXT( pc + ( ( !( R[ip->rs] & 0x80000000 ) || ( R[ip->rt] != 0 ) ) ? ip->imm : 4 ) );
+op_bgez:	NEXT( pc + ( !( R[ip->rs] & 0x80000000 ) ? ip->imm : 4 ) );
+op_b:	NEXT( pc + ip->imm );
+
+op_nop:	NEXT( pc + 4 );
+
+#undef NEXT_R
+#undef NEXT
+
+out:
+	memcpy( CURRENT_STATE.REGS, R, sizeof( R ) );
+	CURRENT_STATE.HI = HI;
+	CURRENT_STATE.LO = LO;
+	CURRENT_STATE.PC = pc;
+	NEXT_STATE = CURRENT_STATE;
+	prevInstruction = prev;
+	INSTRUCTION_COUNT += count;
+	return count;
+#else
+	//no labels-as-values: fall back on the reference interpreter
+	uint32_t count = 0;
+	while( RUN_FLAG && ( max_ins == 0 || count < max_ins ) )
+	{
+		cycle();
+		count++;
+	}
+	return count;
+#endif
+}
+
+/************************************************************/
+/* Fast-forward with the threaded engine and report the rate                   */ 
+/************************************************************/
+void fast_forward( uint32_t max_ins )
+{
+	uint32_t done;
+	clock_t start;
+	double secs;
+
+	if( RUN_FLAG == FALSE )
+	{
+		printf( "Simulation Stopped.\n\n" );
+		return;
+	}
+
+	start = clock();
+	done = run_threaded( max_ins );
+	secs = (double)( clock() - start ) / CLOCKS_PER_SEC;
+
+	printf( "Fast-forwarded %u instructions", done );
+	if( secs > 0 )
+	{
+		printf( " (%.1f MIPS)", done / secs / 1e6 );
+	}
+	printf( "\nPC\t: 0x%08x\n\n", CURRENT_STATE.PC );
+}
+
 
 /************************************************************/
 /* Initialize Memory                                                                                                    */ 
@@ -46,6 +46,12 @@ typedef struct CPU_State_Struct {
 } CPU_State;
 
 
+/* One pre-translated instruction for the threaded engine */
+typedef struct ThreadedIns_Struct {
+  void *op;          /* address of the handler label in run_threaded() */
+  uint8_t rs, rt, rd, sa, func;
+  uint32_t imm;      /* immediate, branch offset or jump target as the handler needs it */
+} ThreadedIns;
 
 /***************************************************************/
 /* CPU State info.                                                                                                               */
@@ -58,6 +64,11 @@ uint32_t PROGRAM_SIZE; /*in words*/
 
 char prog_file[32];
 
+ThreadedIns *THREADED_CODE; /* one slot per program word */
+uint32_t THREADED_SIZE;
+void *THREADED_TRANSLATE; /* label that (re)translates a slot */
+int THREADED_FRESH; /* slots not yet pointed at THREADED_TRANSLATE */
+
 
 /***************************************************************/
 /* Function Declerations.                                                                                                */
@@ -78,5 +89,7 @@ void handle_instruction(); /*IMPLEMENT THIS*/
 void initialize();
 void print_program(); /*IMPLEMENT THIS*/
 void print_instruction(uint32_t);
+uint32_t run_threaded(uint32_t max_ins);
+void fast_forward(uint32_t max_ins);
 
 uint32_t extend_sign( uint32_t );
\ No newline at end of file
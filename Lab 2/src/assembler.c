@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <strings.h>
+
+#include "mu-isa.h"
 
 
 uint32_t getRegister( char * ins )
@@ -154,186 +157,117 @@ void getArg( char * rtn, FILE * fp )
     return;                
 }     
       
-uint32_t encode_rtype( FILE * fp, uint32_t opcode, uint32_t rs, uint32_t rt, uint32_t rd, uint32_t shamt, uint32_t funct )
+int getMnemonic( char * ins )
 {
+    int i;
 
-    rs = rs << 21;
-    rt = rt << 16;
-    rd = rd << 11;    
-    shamt = shamt << 6;  
-    
-    printf( "\nR-TYPE: %x, %x, %x, %x, %x, %x \n", opcode, rs, rt, rd, shamt, funct );
-    
-    return ( opcode + rs + rt + rd + shamt + funct );             
-}
-             
-uint32_t encode_rtype_mult( FILE * fp, uint32_t opcode, uint32_t shamt, uint32_t funct )
-{
-    uint32_t rd = 0, rs = 0, rt = 0;
-    char rs_s[32];
-    char rt_s[32];
-    
-    getArg( rs_s, fp );      
-    getArg( rt_s, fp );      
-              
-    rs = getRegister( rs_s );
-    rt = getRegister( rt_s );    
-      
-    return encode_rtype( fp, opcode, rs, rt, rd, shamt, funct );   
-}
-             
-uint32_t encode_rtype_move( FILE * fp, uint32_t opcode, uint32_t funct )
-{
-    uint32_t rd = 0, rs = 0, rt = 0, shamt = 0;
-    char rd_s[32];
-    
-    getArg( rd_s, fp );      
-              
-    rd = getRegister( rd_s );    
-      
-    return encode_rtype( fp, opcode, rs, rt, rd, shamt, funct );   
-}
-             
-uint32_t encode_rtype_shift( FILE * fp, uint32_t opcode, uint32_t funct )
-{
-    uint32_t rd = 0, rs = 0, rt = 0, shamt = 0;
-    char rs_s[32];
-    char rd_s[32];
-    char shamt_s[32];
-    
-    getArg( rs_s, fp );      
-    getArg( rd_s, fp );    
-    getArg( shamt_s, fp );          
-              
-    rs = getRegister( rs_s );
-    rd = getRegister( rd_s );    
-      
-    return encode_rtype( fp, opcode, rs, rt, rd, shamt, funct );   
-}
+    //ISA_UNKNOWN (row 0) has no mnemonic
+    for( i = 1; i < ISA_COUNT; i++ )
+    {
+        if( strcasecmp( ISA_ENCODING[i].mnem, ins ) == 0 )
+        {
+            return i;
+        }
+    }
 
-uint32_t encode_rtype_generic( FILE * fp, uint32_t opcode, uint32_t shamt, uint32_t funct )
-{
-    uint32_t rd = 0, rs = 0, rt = 0;
-    char rd_s[32];
-    char rs_s[32];
-    char rt_s[32];
-                             
-    getArg( rd_s, fp );      
-    getArg( rs_s, fp );      
-    getArg( rt_s, fp );      
-              
-    rs = getRegister( rs_s );
-    rt = getRegister( rt_s );
-    rd = getRegister( rd_s );
-    
-    return encode_rtype( fp,opcode, rs, rt, rd, shamt, funct );             
+    return ISA_UNKNOWN;
 }
 
-uint32_t encode_itype( FILE * fp, uint32_t opcode, uint32_t rs, uint32_t rt, uint32_t im )
+uint32_t getImmediate( char * ins )
 {
-    rs = rs << 21;
-    rt = rt << 16;  
-    
-    printf( "\nI-TYPE: %x, %x, %x, %x \n", opcode, rs, rt, im );
-    
-    return ( opcode + rs + rt + im );   
+    //Immediates, offsets and targets are all written in hex
+    return (uint32_t) strtol( ins, NULL, 16 );
 }
 
-uint32_t encode_itype_store( FILE * fp, uint32_t opcode )
+void getMemArg( FILE * fp, uint32_t * im, uint32_t * base )
 {
-    uint32_t rs = 0, rt = 0, im = 0;
-    char rt_s[32];
     char pt2[32];
-    char * im_s, *base_s;
-        
-    getArg( rt_s, fp );         
-    getArg( pt2, fp );  
-    
+    char * im_s, * base_s;
+
+    getArg( pt2, fp );
+
     //Extract register from code (miserable)
-    char * search = "(";
-    char * search2 = ")";
-    im_s = strtok( pt2, search );
-    base_s = strtok( NULL, search2 );
-      
-    //Base  
-    rs = getRegister( base_s );
-    
-    //rt
-    rt = getRegister( rt_s );
-    
-    //Convert IMmediate to hex uint32_t
-    im = (uint32_t) strtol( im_s, NULL, 16 );
-    
-    //STORE TEST
-    /*printf( "\nSTORE:" 
-            "\n-> %s" 
-            "\n-> %s" 
-            "\n-> %x\n"
-            , base_s, rt_s, im
-    ); */
-    
-    return encode_itype( fp, opcode, rs, rt, im );   
-}
+    im_s = strtok( pt2, "(" );
+    base_s = strtok( NULL, ")" );
 
-uint32_t encode_itype_branch( FILE * fp, uint32_t opcode, uint32_t bgez )
-{
-    uint32_t rs = 0, rt = 0, im = 0;
-    char rs_s[32];
-    char im_s[32];
-        
-    getArg( rs_s, fp );         
-    getArg( im_s, fp );  
-        
-    rt = bgez;
-    rs = getRegister( rs_s );
-    im = (uint32_t) strtol( im_s, NULL, 16 );
-    
-    return encode_itype( fp, opcode, rs, rt, im );   
+    *im = getImmediate( im_s );
+    *base = base_s ? getRegister( base_s ) : 0;
 }
 
-uint32_t encode_itype_loadim( FILE * fp, uint32_t opcode )
+/* Read the operands the ISA table lists for instruction index and encode it */
+uint32_t encode_ins( FILE * fp, int index )
 {
-    uint32_t rs = 0, rt = 0, im = 0;
-    char rt_s[32];
-    char im_s[32];
-        
-    getArg( rt_s, fp );         
-    getArg( im_s, fp );  
-        
-    rt = getRegister( rt_s );
-    im = (uint32_t) strtol( im_s, NULL, 16 );
-    
-    return encode_itype( fp, opcode, rs, rt, im );   
-}
+    const IsaEncoding * e = &ISA_ENCODING[index];
+    uint32_t rs = 0, rt = 0, rd = 0, sa = 0, im = 0;
+    char a[32], b[32], c[32];
 
-uint32_t encode_itype_generic( FILE * fp, uint32_t opcode )
-{
-    uint32_t rs = 0, rt = 0, im = 0;
-    char rs_s[32];
-    char rt_s[32];
-    char im_s[32];
-    
-    getArg( rt_s, fp );      
-    getArg( rs_s, fp );         
-    getArg( im_s, fp );  
-        
-    rt = getRegister( rt_s );
-    rs = getRegister( rs_s );
-    im = (uint32_t) strtol( im_s, NULL, 16 );
-    
-    return encode_itype( fp, opcode, rs, rt, im );   
-}
+    switch( e->fmt )
+    {
+      case ISA_FMT_RRR:
+        getArg( a, fp ); getArg( b, fp ); getArg( c, fp );
+        rd = getRegister( a ); rs = getRegister( b ); rt = getRegister( c );
+        break;
+      case ISA_FMT_RR:
+        getArg( a, fp ); getArg( b, fp );
+        rs = getRegister( a ); rt = getRegister( b );
+        break;
+      case ISA_FMT_SHIFT:
+        getArg( a, fp ); getArg( b, fp ); getArg( c, fp );
+        rd = getRegister( a ); rt = getRegister( b ); sa = getImmediate( c );
+        break;
+      case ISA_FMT_RS:
+        getArg( a, fp );
+        rs = getRegister( a );
+        break;
+      case ISA_FMT_RD:
+        getArg( a, fp );
+        rd = getRegister( a );
+        break;
+      case ISA_FMT_RD_RS:
+        getArg( a, fp ); getArg( b, fp );
+        rd = getRegister( a ); rs = getRegister( b );
+        break;
+      case ISA_FMT_TARGET:
+        getArg( a, fp );
+        im = getImmediate( a );
+        break;
+      case ISA_FMT_RT_RS_IMM:
+        getArg( a, fp ); getArg( b, fp ); getArg( c, fp );
+        rt = getRegister( a ); rs = getRegister( b ); im = getImmediate( c );
+        break;
+      case ISA_FMT_RT_IMM:
+        getArg( a, fp ); getArg( b, fp );
+        rt = getRegister( a ); im = getImmediate( b );
+        break;
+      case ISA_FMT_MEM:
+        getArg( a, fp );
+        rt = getRegister( a );
+        getMemArg( fp, &im, &rs );
+        break;
+      case ISA_FMT_RS_RT_OFF:
+        getArg( a, fp ); getArg( b, fp ); getArg( c, fp );
+        rs = getRegister( a ); rt = getRegister( b ); im = getImmediate( c );
+        break;
+      case ISA_FMT_RS_OFF:
+        getArg( a, fp ); getArg( b, fp );
+        rs = getRegister( a ); im = getImmediate( b );
+        break;
+    }
 
-uint32_t encode_jtype( FILE * fp, uint32_t opcode )
-{
-    uint32_t target = 0;
-    char target_s[32];
-    
-    getArg( target_s, fp );    
-    
-    printf( "\nJ-TYPE: %x, %x\n", opcode, target );
-    
-    return ( opcode + target );   
+    if( e->fmt == ISA_FMT_TARGET )
+    {
+        printf( "\nJ-TYPE: %x, %x\n", e->op, im );
+    }
+    else if( e->space == ISA_SPECIAL )
+    {
+        printf( "\nR-TYPE: %x, %x, %x, %x, %x, %x \n", e->op, rs, rt, rd, sa, e->key );
+    }
+    else
+    {
+        printf( "\nI-TYPE: %x, %x, %x, %x \n", e->op, rs, rt, im );
+    }
+
+    return isa_encode( index, rs, rt, rd, sa, im );
 }
 
 int main(int argc, char *argv[]) 
@@ -373,254 +307,15 @@ int main(int argc, char *argv[])
 	while( fscanf( fp, "%s", data) != EOF )
 	{
     printf( "\n%d : %s", ++i, data );
-    uint32_t opcode = 0x0, shamt = 0x0, funct = 0x0;
-    
-    if( strcmp( data, "add" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000020;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct );
-    }
-    if( strcmp( data, "addu" ) == 0 )
-    {             
-      opcode = 0x00000000;   
-      shamt = 0x00000000;
-      funct = 0x00000021;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct );
-    }   
-    else if( strcmp( data, "addi" ) == 0 )
-    {         
-      opcode = 0x20000000;
-      ins = encode_itype_generic( fp, opcode );
-    }
-    else if( strcmp( data, "addiu" ) == 0 )
-    {         
-      opcode = 0x24000000;
-      ins = encode_itype_generic( fp, opcode );
-    }  
-    else if( strcmp( data, "sub" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000022;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct );
-    }
-    else if( strcmp( data, "subu" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000023;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct );
-    }
-    else if( strcmp( data, "mult" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000028;
-      
-      ins = encode_rtype_mult( fp, opcode, shamt, funct );
-    }
-    else if( strcmp( data, "multu" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000029;
-      ins = encode_rtype_mult( fp, opcode, shamt, funct );
-    }
-    else if( strcmp( data, "div" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x0000002A;
-      ins = encode_rtype_mult( fp, opcode, shamt, funct );
-    }
-    else if( strcmp( data, "divu" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x0000002B;
-      ins = encode_rtype_mult( fp, opcode, shamt, funct );
-    }
-    else if( strcmp( data, "and" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000023;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct);
-    }
-    else if( strcmp( data, "andi" ) == 0 )
-    {         
-      opcode = 0x30000000;
-      ins = encode_itype_generic( fp, opcode );
-    }  
-    else if( strcmp( data, "or" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000025;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct );
-    }
-    else if( strcmp( data, "ori" ) == 0 )
-    {         
-      opcode = 0x34000000;
-      ins = encode_itype_generic( fp, opcode );
-    } 
-    else if( strcmp( data, "xor" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000026;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct );
-    }
-    else if( strcmp( data, "xori" ) == 0 )
-    {         
-      opcode = 0x38000000;
-      ins = encode_itype_generic( fp, opcode );
-    }  
-    else if( strcmp( data, "nor" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000027;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct);
-    }
-    else if( strcmp( data, "slt" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x0000002A;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct );
-    }
-    else if( strcmp( data, "slti" ) == 0 )
-    {         
-      opcode = 0x28000000;
-      ins = encode_itype_generic( fp, opcode );
-    }     
-    else if( strcmp( data, "sll" ) == 0 )
-    {
-      opcode = 0x00000000;
-      funct = 0x00000000;
-      ins = encode_rtype_shift( fp, opcode, funct );
-    }
-    else if( strcmp( data, "srl" ) == 0 )
-    {
-      opcode = 0x00000000;
-      funct = 0x00000002;
-      ins = encode_rtype_shift( fp, opcode, funct );
-    }
-    else if( strcmp( data, "sra" ) == 0 )
-    {
-      opcode = 0x00000000;
-      funct = 0x00000003;
-      ins = encode_rtype_shift( fp, opcode, funct );
-    }
-    else if( strcmp( data, "lw" ) == 0 )
-    {         
-      opcode = 0x8C000000;
-      ins = encode_itype_store( fp, opcode );
-    }  
-    else if( strcmp( data, "lb" ) == 0 )
-    {         
-      opcode = 0x80000000;
-      ins = encode_itype_store( fp, opcode );
-    }  
-    else if( strcmp( data, "lh" ) == 0 )
-    {         
-      opcode = 0x84000000;
-      ins = encode_itype_store( fp, opcode );
-    }  
-    else if( strcmp( data, "sw" ) == 0 )
-    {         
-      opcode = 0xAC000000;
-      ins = encode_itype_store( fp, opcode );
-    }  
-    else if( strcmp( data, "sb" ) == 0 )
-    {         
-      opcode = 0xA0000000;
-      ins = encode_itype_store( fp, opcode );
-    }  
-    else if( strcmp( data, "sh" ) == 0 )
-    {         
-      opcode = 0xA4000000;
-      ins = encode_itype_store( fp, opcode );
-    }  
-    else if( strcmp( data, "mfhi" ) == 0 )
-    {
-      opcode = 0x00000000;
-      funct = 0x00000002;
-      ins = encode_rtype_move( fp, opcode, funct );
-    }
-else if( strcmp( data, "jalr" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000009;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct );
-    }
-else if( strcmp( data, "jal" ) == 0 )
-    {
-      opcode = 0x0C000000;
-      ins = encode_jtype( fp, opcode );
-    }
-else if( strcmp( data, "jr" ) == 0 )
-    {
-      opcode = 0x00000000;
-      shamt = 0x00000000;
-      funct = 0x00000008;
-      ins = encode_rtype_generic( fp, opcode, shamt, funct );
-    }
-else if( strcmp( data, "j" ) == 0 )
-    {
-      opcode = 0x04000000;
-      ins = encode_jtype( fp, opcode );
-    }
-else if( strcmp( data, "beq" ) == 0 )
-    {
-      opcode = 0x10000000;
-      ins = encode_itype_generic( fp, opcode );
-    }
-else if( strcmp( data, "bne" ) == 0 )
-    {
-      opcode = 0x14000000;
-      ins = encode_itype_generic( fp, opcode );
-    }
-else if( strcmp( data, "blez" ) == 0 )
-    {
-	//special case
-      opcode = 0x04000000;
-      ins = encode_itype_branch( fp, opcode, 0x0 );
-    }
-else if( strcmp( data, "bltz" ) == 0 )
-    {
-	//special case
-      opcode = 0x18000000;
-	    uint32_t rt = 0x0; 
-      ins = encode_itype_branch( fp, opcode, rt );
-    }  
-else if( strcmp( data, "bgez" ) == 0 )
-    {
-	//special case
-      opcode = 0x04000000;
-      uint32_t rt = 0x1;
-      ins = encode_itype_branch( fp, opcode, rt );
-    }
-else if( strcmp( data, "bgtz" ) == 0 )
-    {
-        opcode = 0x1C000000;
-  	    uint32_t rt = 0x0;
-        ins = encode_itype_branch( fp, opcode, rt );
-    }
-    else if( strcmp( data, "mflo" ) == 0 )
-    {
-        opcode = 0x04000000;
-        ins = encode_itype_generic( fp, opcode );
-    }
-    else if( strcmp( data, "syscall" ) == 0 )
+    int index = getMnemonic( data );
+
+    if( index == ISA_UNKNOWN )
     {
-        ins = 0xC;
-        printf("\n");
+      printf( "\nError: unknown instruction %s, skipped\n", data );
+      continue;
     }
+
+    ins = encode_ins( fp, index );
     
     printf( "INSTRUCTION: %x\n", ins);
     fprintf( fw, "%x\n", ins );
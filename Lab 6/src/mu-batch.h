@@ -0,0 +1,88 @@
+/******************************************************************************/
+/* LOCKSTEP BATCH EXECUTION                                                   */
+/******************************************************************************/
+/* batch runs the loaded program as up to BATCH_MAX_LANES independent        */
+/* instances ("lanes"), each starting from the current architectural state  */
+/* with its own slice of an input file stored into its own memory.          */
+/*                                                                            */
+/* Register files are kept structure-of-arrays, REGS[reg][lane], so one      */
+/* decoded instruction is applied to BATCH_VEC lanes per host vector op.    */
+/* The vector kernel is built twice, for AVX2 and for the baseline ISA, and  */
+/* the loader picks the one the host supports.                              */
+/*                                                                            */
+/* All lanes start in one lockstep group that shares a PC. When a branch     */
+/* splits the group, the larger side keeps going and the other lanes are    */
+/* parked at their own PC. Parked lanes rejoin when the group jumps to their */
+/* PC; once the group finishes, the parked lanes at the lowest PC form the  */
+/* next group. A group of one lane runs scalar.                              */
+/*                                                                            */
+/* Each lane reads the shared guest memory and copies a page privately the  */
+/* first time it writes it, so lanes never see each other's stores and the  */
+/* simulator's own memory and registers are left untouched.                 */
+/*                                                                            */
+/* A run ends when every lane reached SYSCALL or after a budget of          */
+/* instructions over all lanes; lanes still running then are reported as  */
+/* stopped.                                                                 */
+/******************************************************************************/
+#define BATCH_MAX_LANES 1024
+#define BATCH_VEC 8 //lanes per 256-bit host vector
+#define BATCH_LANE_PAGES 32 //private guest pages per lane
+#define BATCH_DEFAULT_MAX_INS 1000000000u //instructions over all lanes before a run is stopped
+
+/* Lane states */
+#define BATCH_DONE   0 //reached SYSCALL, or padding past the last lane
+#define BATCH_GROUP  1 //executing in the lockstep group
+#define BATCH_PARKED 2 //diverged, waiting at its own pc
+
+typedef uint32_t BatchVec __attribute__((vector_size(BATCH_VEC * 4)));
+
+typedef struct BatchPage_Struct {
+
+  uint32_t vpn; //guest page number
+  uint32_t *page; //the lane's private copy
+
+} BatchPage;
+
+typedef struct BatchLane_Struct {
+
+  uint32_t pc; //next instruction while parked
+  uint8_t state; //BATCH_*
+  uint32_t num_pages;
+  BatchPage pages[BATCH_LANE_PAGES]; //pages this lane has written, all others are read from guest memory
+
+} BatchLane;
+
+typedef struct BatchState_Struct {
+
+  uint32_t REGS[MIPS_REGS][BATCH_MAX_LANES] __attribute__((aligned(32))); //register r of every lane
+  uint32_t HI[BATCH_MAX_LANES] __attribute__((aligned(32)));
+  uint32_t LO[BATCH_MAX_LANES] __attribute__((aligned(32)));
+  uint32_t mask[BATCH_MAX_LANES] __attribute__((aligned(32))); //all ones for lanes in the group
+  uint32_t taken[BATCH_MAX_LANES] __attribute__((aligned(32))); //nonzero where the last branch is taken
+
+  BatchLane lane[BATCH_MAX_LANES];
+  uint32_t num_lanes;
+
+  uint32_t group_pc; //pc shared by the group
+  uint32_t group[BATCH_MAX_LANES]; //lanes in the group
+  uint32_t group_size;
+  uint32_t num_parked; //lanes in BATCH_PARKED
+
+} BatchState;
+
+
+/***************************************************************/
+/* BATCH OBJECT                                                */
+/***************************************************************/
+BatchState BATCH;
+
+uint64_t BATCH_INSTRUCTIONS; //instructions retired over all lanes
+uint64_t BATCH_VECTOR_STEPS; //instructions applied to the whole group by the vector kernel
+uint64_t BATCH_SCALAR_STEPS; //instructions run lane by lane
+uint64_t BATCH_DIVERGED; //lanes parked by divergent branches
+
+
+/***************************************************************/
+/* Function Declerations.                                      */
+/***************************************************************/
+void batch_run(uint32_t lanes, const char *in_path, uint32_t in_addr, const char *out_path, uint32_t max_ins);
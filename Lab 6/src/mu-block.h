@@ -0,0 +1,108 @@
+/******************************************************************************/
+/* BASIC-BLOCK TRANSLATION CACHE                                              */
+/******************************************************************************/
+/* The functional engine (frun) skips the pipeline and executes whole guest  */
+/* basic blocks. A block runs from its entry PC up to and including the     */
+/* first branch, jump or SYSCALL (or the end of its page), and is stored as */
+/* a compact array of micro-ops built from the predecoded instructions.     */
+/*                                                                            */
+/* Each block remembers the blocks it last exited to, one slot for the      */
+/* taken path and one for the fall-through path, so straight-line control   */
+/* flow goes block to block without a lookup. Only JR/JALR and cache misses */
+/* go back to the dispatcher.                                                 */
+/*                                                                            */
+/* A store into a code page (MEM_PAGE_CODE) retires exactly the blocks     */
+/* covering the stored words: they leave the block map, every chain into   */
+/* them is cut, and they wait on BLOCK_DEAD until the running block has     */
+/* been left, since the store may have come from inside it.                 */
+/*                                                                            */
+/* While translating, adjacent pairs forming a common idiom are fused: the  */
+/* first op becomes a UOP_F_* that executes both instructions in a single   */
+/* dispatch, and the second op stays in place as its operand record. The    */
+/* pairs are lui+ori (constant), addi/addiu+lw on the same base (address +  */
+/* load) and slt+bne/beq on the slt result (compare + branch).              */
+/*                                                                            */
+/* ff/ffpc drain the pipeline, run the functional engine up to a count or a */
+/* PC, and then restart the detailed-phase counters so that later sim/run   */
+/* statistics cover only the region of interest.                             */
+/******************************************************************************/
+#define BLOCK_MAX_OPS 64
+#define FUNC_NO_STOP 0xFFFFFFFF //run_blocks() stop_pc when only the instruction budget applies
+
+/* Micro-op kinds */
+enum {
+  UOP_NOP, UOP_ADD, UOP_SUB, UOP_MUL, UOP_DIV, UOP_DIVU,
+  UOP_AND, UOP_OR, UOP_XOR, UOP_NOR, UOP_SLT,
+  UOP_SLL, UOP_SRL, UOP_SRA,
+  UOP_MTLO, UOP_MTHI, UOP_MFLO, UOP_MFHI,
+  UOP_ADDI, UOP_ANDI, UOP_ORI, UOP_XORI, UOP_LUI, UOP_SLTI,
+  UOP_LW, UOP_LB, UOP_LH, UOP_SW, UOP_SB, UOP_SH,
+  /* fused pairs: the next op is the second half */
+  UOP_F_LUI_ORI, UOP_F_ADDI_LW, UOP_F_SLT_BR,
+  /* everything from here on ends a block */
+  UOP_BEQ, UOP_BNE, UOP_BLEZ, UOP_BGTZ, UOP_BLTZ, UOP_BGEZ,
+  UOP_J, UOP_JR, UOP_JALR, UOP_SYSCALL
+};
+
+#define UOP_ENDS_BLOCK(op) ( (op) >= UOP_BEQ )
+
+typedef struct MicroOp_Struct {
+
+  uint8_t op; //UOP_*
+  uint8_t rs, rt, rd;
+  uint32_t imm; //immediate ready to use, shift amount, or absolute branch/jump target
+
+} MicroOp;
+
+typedef struct Block_Struct Block;
+struct Block_Struct {
+
+  uint32_t pc; //guest address of the first micro-op
+  uint32_t num_ops;
+  uint32_t exec_count; //times the block has been entered
+  uint32_t num_fused; //fused pairs among ops
+  Block *succ[2]; //chained successor on the taken [0] and fall-through [1] exits, NULL until first used
+  void *jit; //host code from jit_compile(), NULL while interpreted
+  int jit_tried; //TRUE once compiling has been attempted
+  Block *next; //all cached blocks, for flushing
+  MicroOp ops[]; //one per guest instruction
+
+};
+
+typedef struct BlockPage_Struct {
+
+  Block *entry[MEM_PAGE_WORDS]; //block starting at each word of the text page
+
+} BlockPage;
+
+
+/***************************************************************/
+/* BLOCK CACHE OBJECT                                          */
+/***************************************************************/
+BlockPage *BLOCK_MAP[DECODE_TEXT_PAGES]; //NULL until a block starts in the page
+Block *BLOCK_LIST; //every cached block
+Block *BLOCK_DEAD; //retired blocks, freed by block_reap()
+int BLOCK_STALE; //set when a block is retired; the running block stops after the current op
+
+uint64_t BLOCKS_TRANSLATED; //blocks built since start
+uint64_t BLOCKS_INVALIDATED; //blocks retired by stores into code
+uint64_t BLOCK_LOOKUPS; //entries through the dispatcher
+uint64_t BLOCK_CHAINED; //entries through a chained exit
+
+int FUSE_ENABLED = 1; //block_translate() fuses idiom pairs
+uint64_t FUSED_PAIRS; //fused pairs executed by completed blocks
+
+int FUNC_WARM_CACHE; //functional loads/stores also fill L1Cache, so detailed runs start warm
+uint32_t FF_INSTRUCTIONS; //instructions skipped by fast-forwarding since the last reset
+
+
+/***************************************************************/
+/* Function Declerations.                                      */
+/***************************************************************/
+Block *block_lookup(uint32_t pc);
+void block_invalidate(uint32_t address, uint32_t size);
+void block_reap();
+void block_flush();
+uint32_t run_blocks(uint32_t max_ins, uint32_t stop_pc);
+void frun(uint32_t max_ins, uint32_t stop_pc);
+void fast_forward(uint32_t max_ins, uint32_t stop_pc);
@@ -0,0 +1,51 @@
+/******************************************************************************/
+/* PREDECODED INSTRUCTION CACHE                                               */
+/******************************************************************************/
+/* Every text word is decoded the first time it is fetched: register fields, */
+/* sign-extended immediate, pipeline class and the EX handler are stored in */
+/* a DecodedIns that then rides down the pipeline latches with the          */
+/* instruction, so ID and EX never pick apart raw IR bits again. The class */
+/* and handler come from ISA_EXEC, the dispatch array mu-mips.c expands    */
+/* from ISA_TABLE (mu-isa.h), indexed by a single isa_lookup().             */
+/*                                                                            */
+/* Decoded words live in lazily allocated pages that mirror the text pages  */
+/* of guest memory; each such guest page is marked MEM_PAGE_CODE. A store   */
+/* into a marked page clears the affected entries; loading a new program,   */
+/* mapping an image or restoring a snapshot drops them all.                 */
+/******************************************************************************/
+#define DECODE_TEXT_PAGES ( MEM_VPN(MEM_TEXT_END) - MEM_VPN(MEM_TEXT_BEGIN) + 1 )
+#define DECODE_IS_TEXT(addr) ( (addr) >= MEM_TEXT_BEGIN && (addr) <= MEM_TEXT_END )
+
+typedef struct DecodedPage_Struct {
+
+  DecodedIns ins[MEM_PAGE_WORDS]; //one entry per word of the guest page
+
+} DecodedPage;
+
+typedef struct IsaExec_Struct {
+
+  void (*handler)(const DecodedIns *d); //EX stage behaviour
+  uint8_t uop; //UOP_* for the block translator
+  uint8_t type; //pipeline class
+  uint8_t RegWrite;
+  uint8_t dst; //ISA_DST_* field copied into DestReg
+  uint8_t size; //load/store width in bytes
+
+} IsaExec;
+
+
+/***************************************************************/
+/* DECODE CACHE OBJECT                                         */
+/***************************************************************/
+DecodedPage *DECODE_CACHE[DECODE_TEXT_PAGES]; //NULL until a word of the page is fetched
+
+const DecodedIns DECODE_BUBBLE; //all-zero entry carried by stalled latches
+
+
+/***************************************************************/
+/* Function Declerations.                                      */
+/***************************************************************/
+void decode_ins(DecodedIns *d, uint32_t ins);
+const DecodedIns *decode_fetch(uint32_t pc);
+void decode_invalidate(uint32_t address, uint32_t size);
+void decode_flush();
@@ -0,0 +1,103 @@
+/******************************************************************************/
+/* BINARY PIPELINE EVENTS                                                     */
+/******************************************************************************/
+/* While `events <file>` is on, every stage records one fixed-size PipeEvent */
+/* per cycle instead of formatting text: the cycle, the stage, the PC and IR */
+/* it held, what happened (ran, bubble, stall, flush) and why.              */
+/*                                                                            */
+/* Events go into a ring of EVENT_RING_SIZE entries. Recording one is a     */
+/* 24-byte store and an index bump; only the producer moves head, and the   */
+/* ring is written out with a single fwrite each time it fills, so there is */
+/* no lock and no per-event I/O.                                            */
+/*                                                                            */
+/* The file starts with a PipeEventHeader followed by raw host-endian       */
+/* events. mu-trace-dump turns it back into text or per-cycle pipeline      */
+/* snapshots. The same events can also drive the pipeline viewer export  */
+/* of mu-pipeview.h. Events follow the `tfilter` settings of mu-trace.h.   */
+/******************************************************************************/
+#define EVENT_MAGIC "MUEV"
+#define EVENT_VERSION 1
+#define EVENT_RING_SIZE (1 << 16) //events buffered per write, a power of two
+
+/* Stages */
+#define EV_IF  0
+#define EV_ID  1
+#define EV_EX  2
+#define EV_MEM 3
+#define EV_WB  4
+#define EV_NUM_STAGES 5
+
+/* Kinds */
+#define EV_RUN    0 //the stage worked on pc/ir
+#define EV_BUBBLE 1 //the stage held no instruction
+#define EV_STALL  2 //the stage held pc/ir but could not advance
+#define EV_FLUSH  3 //pc/ir was squashed by a taken branch or jump
+
+/* Stall reasons */
+#define EV_REASON_NONE   0
+#define EV_REASON_HAZARD 1 //CNT_STALL: data hazard or branch resolution
+#define EV_REASON_CACHE  2 //MEM_STALL: L1Cache miss being filled
+#define EV_REASON_DRAIN  3 //pipeline draining, nothing fetched
+
+/* Flags */
+#define EV_FLAG_HIT     0x01 //load/store hit L1Cache
+#define EV_FLAG_MISS    0x02 //load/store missed L1Cache
+#define EV_FLAG_BRANCH  0x04 //taken branch: fetch redirected
+#define EV_FLAG_JUMP    0x08 //jump: fetch redirected
+#define EV_FLAG_FWD_MEM 0x10 //operand forwarded from MEM/WB
+#define EV_FLAG_FWD_EX  0x20 //operand forwarded from EX/MEM
+
+typedef struct PipeEvent_Struct {
+
+  uint64_t cycle;
+  uint32_t pc;
+  uint32_t ir;
+  uint32_t data; //ALU result, effective address or value written back
+  uint8_t stage; //EV_IF..EV_WB
+  uint8_t kind; //EV_RUN..EV_FLUSH
+  uint8_t reason; //EV_REASON_*
+  uint8_t flags; //EV_FLAG_*
+
+} PipeEvent;
+
+typedef struct PipeEventHeader_Struct {
+
+  char magic[4]; //EVENT_MAGIC
+  uint32_t version; //EVENT_VERSION
+  uint32_t event_size; //sizeof(PipeEvent) of the writer
+  uint32_t reserved;
+
+} PipeEventHeader;
+
+/* Consumers of recorded events */
+#define EVENT_TO_FILE     0x1 //`events <file>`
+#define EVENT_TO_PIPEVIEW 0x2 //`pipeview <file>`, see mu-pipeview.h
+
+#define EVENT(stage, kind, reason, flags, pc, ir, data) \
+	do { if (EVENTS.sinks && TRACE_PASS) event_record(stage, kind, reason, flags, pc, ir, data); } while (0)
+
+typedef struct EventRing_Struct {
+
+  PipeEvent *ring; //EVENT_RING_SIZE entries
+  uint64_t head; //events recorded
+  uint64_t written; //events handed to fp
+  FILE *fp; //NULL while recording to a file is off
+  int sinks; //EVENT_TO_* consumers, 0 when nothing is recorded
+
+} EventRing;
+
+
+/***************************************************************/
+/* EVENT RECORDER                                              */
+/***************************************************************/
+EventRing EVENTS;
+
+
+/***************************************************************/
+/* Function Declerations.                                      */
+/***************************************************************/
+int event_open(const char *path);
+int pipeview_open(const char *path);
+void pipeview_close();
+void event_flush();
+void event_close();
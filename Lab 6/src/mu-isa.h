@@ -0,0 +1,200 @@
+/******************************************************************************/
+/* MU-MIPS INSTRUCTION SET TABLE                                              */
+/******************************************************************************/
+/* Every instruction the simulator knows is listed exactly once in ISA_TABLE. */
+/* The simulator expands it into its decode maps, the EX dispatch array and   */
+/* the disassembler; the Lab 2 assembler expands the same list to encode     */
+/* mnemonics. A new instruction only needs a new row here plus its handler.  */
+/*                                                                            */
+/* Columns:                                                                   */
+/*   name     ISA_<name> index and ex_<name> EX handler                      */
+/*   mnem     mnemonic as printed by the disassembler (the assembler ignores  */
+/*            case)                                                           */
+/*   space    ISA_PRIMARY: keyed by opcode                                    */
+/*            ISA_SPECIAL: opcode 0x00, keyed by funct                        */
+/*            ISA_REGIMM:  opcode 0x01, keyed by rt                           */
+/*   op, key  opcode and the funct/rt value that selects the row             */
+/*   fmt      ISA_FMT_* operand layout, shared by assembly and disassembly    */
+/*   uop      micro-op used by the block translator                           */
+/*   type     pipeline class: 0 R, 1 I-ALU, 2 load, 3 store, 4 syscall,      */
+/*            5 nop, 6 branch                                                 */
+/*   wr, dst  RegWrite and the field naming the destination register         */
+/*   size     bytes moved by a load/store, 4 for everything else              */
+/******************************************************************************/
+#define ISA_TABLE(X) \
+	/* name      mnem        space         op     key    fmt                 uop           type  wr  dst            size */ \
+	X( ADD,      "ADD",      ISA_SPECIAL,  0x00,  0x20,  ISA_FMT_RRR,        UOP_ADD,      0,    1,  ISA_DST_RD,    4 ) \
+	X( ADDU,     "ADDU",     ISA_SPECIAL,  0x00,  0x21,  ISA_FMT_RRR,        UOP_ADD,      0,    1,  ISA_DST_RD,    4 ) \
+	X( SUB,      "SUB",      ISA_SPECIAL,  0x00,  0x22,  ISA_FMT_RRR,        UOP_SUB,      0,    1,  ISA_DST_RD,    4 ) \
+	X( SUBU,     "SUBU",     ISA_SPECIAL,  0x00,  0x23,  ISA_FMT_RRR,        UOP_SUB,      0,    1,  ISA_DST_RD,    4 ) \
+	X( MULT,     "MULT",     ISA_SPECIAL,  0x00,  0x18,  ISA_FMT_RR,         UOP_MUL,      0,    1,  ISA_DST_RD,    4 ) \
+	X( MULTU,    "MULTU",    ISA_SPECIAL,  0x00,  0x19,  ISA_FMT_RR,         UOP_MUL,      0,    1,  ISA_DST_RD,    4 ) \
+	X( DIV,      "DIV",      ISA_SPECIAL,  0x00,  0x1A,  ISA_FMT_RR,         UOP_DIV,      0,    1,  ISA_DST_RD,    4 ) \
+	X( DIVU,     "DIVU",     ISA_SPECIAL,  0x00,  0x1B,  ISA_FMT_RR,         UOP_DIVU,     5,    1,  ISA_DST_RD,    4 ) \
+	X( AND,      "AND",      ISA_SPECIAL,  0x00,  0x24,  ISA_FMT_RRR,        UOP_AND,      0,    1,  ISA_DST_RD,    4 ) \
+	X( OR,       "OR",       ISA_SPECIAL,  0x00,  0x25,  ISA_FMT_RRR,        UOP_OR,       0,    1,  ISA_DST_RD,    4 ) \
+	X( XOR,      "XOR",      ISA_SPECIAL,  0x00,  0x26,  ISA_FMT_RRR,        UOP_XOR,      0,    1,  ISA_DST_RD,    4 ) \
+	X( NOR,      "NOR",      ISA_SPECIAL,  0x00,  0x27,  ISA_FMT_RRR,        UOP_NOR,      0,    1,  ISA_DST_RD,    4 ) \
+	X( SLT,      "SLT",      ISA_SPECIAL,  0x00,  0x2A,  ISA_FMT_RRR,        UOP_SLT,      0,    1,  ISA_DST_RD,    4 ) \
+	X( SLL,      "SLL",      ISA_SPECIAL,  0x00,  0x00,  ISA_FMT_SHIFT,      UOP_SLL,      0,    1,  ISA_DST_RD,    4 ) \
+	X( SRL,      "SRL",      ISA_SPECIAL,  0x00,  0x02,  ISA_FMT_SHIFT,      UOP_SRL,      0,    1,  ISA_DST_RD,    4 ) \
+	X( SRA,      "SRA",      ISA_SPECIAL,  0x00,  0x03,  ISA_FMT_SHIFT,      UOP_SRA,      0,    1,  ISA_DST_RD,    4 ) \
+	X( SYSCALL,  "SYSCALL",  ISA_SPECIAL,  0x00,  0x0C,  ISA_FMT_NONE,       UOP_SYSCALL,  4,    1,  ISA_DST_RD,    4 ) \
+	X( MTLO,     "MTLO",     ISA_SPECIAL,  0x00,  0x13,  ISA_FMT_RS,         UOP_MTLO,     5,    1,  ISA_DST_RD,    4 ) \
+	X( MTHI,     "MTHI",     ISA_SPECIAL,  0x00,  0x11,  ISA_FMT_RS,         UOP_MTHI,     5,    1,  ISA_DST_RD,    4 ) \
+	X( MFLO,     "MFLO",     ISA_SPECIAL,  0x00,  0x12,  ISA_FMT_RD,         UOP_MFLO,     0,    1,  ISA_DST_RD,    4 ) \
+	X( MFHI,     "MFHI",     ISA_SPECIAL,  0x00,  0x10,  ISA_FMT_RD,         UOP_MFHI,     0,    1,  ISA_DST_RD,    4 ) \
+	X( JR,       "JR",       ISA_SPECIAL,  0x00,  0x08,  ISA_FMT_RS,         UOP_JR,       6,    0,  ISA_DST_NONE,  4 ) \
+	X( JALR,     "JALR",     ISA_SPECIAL,  0x00,  0x09,  ISA_FMT_RD_RS,      UOP_JALR,     0,    0,  ISA_DST_NONE,  4 ) \
+	X( J,        "J",        ISA_PRIMARY,  0x02,  0x00,  ISA_FMT_TARGET,     UOP_J,        6,    0,  ISA_DST_NONE,  4 ) \
+	X( JAL,      "JAL",      ISA_PRIMARY,  0x03,  0x00,  ISA_FMT_TARGET,     UOP_J,        6,    0,  ISA_DST_NONE,  4 ) \
+	X( ADDI,     "ADDI",     ISA_PRIMARY,  0x08,  0x00,  ISA_FMT_RT_RS_IMM,  UOP_ADDI,     1,    1,  ISA_DST_RT,    4 ) \
+	X( ADDIU,    "ADDIU",    ISA_PRIMARY,  0x09,  0x00,  ISA_FMT_RT_RS_IMM,  UOP_ADDI,     1,    1,  ISA_DST_RT,    4 ) \
+	X( ANDI,     "ANDI",     ISA_PRIMARY,  0x0C,  0x00,  ISA_FMT_RT_RS_IMM,  UOP_ANDI,     1,    1,  ISA_DST_RT,    4 ) \
+	X( LUI,      "LUI",      ISA_PRIMARY,  0x0F,  0x00,  ISA_FMT_RT_IMM,     UOP_LUI,      1,    1,  ISA_DST_RT,    4 ) \
+	X( XORI,     "XORI",     ISA_PRIMARY,  0x0E,  0x00,  ISA_FMT_RT_RS_IMM,  UOP_XORI,     1,    1,  ISA_DST_RT,    4 ) \
+	X( ORI,      "ORI",      ISA_PRIMARY,  0x0D,  0x00,  ISA_FMT_RT_RS_IMM,  UOP_ORI,      1,    1,  ISA_DST_RT,    4 ) \
+	X( SLTI,     "SLTI",     ISA_PRIMARY,  0x0A,  0x00,  ISA_FMT_RT_RS_IMM,  UOP_SLTI,     1,    1,  ISA_DST_RT,    4 ) \
+	X( SB,       "SB",       ISA_PRIMARY,  0x28,  0x00,  ISA_FMT_MEM,        UOP_SB,       3,    0,  ISA_DST_RT,    1 ) \
+	X( SH,       "SH",       ISA_PRIMARY,  0x29,  0x00,  ISA_FMT_MEM,        UOP_SH,       3,    0,  ISA_DST_RT,    2 ) \
+	X( SW,       "SW",       ISA_PRIMARY,  0x2B,  0x00,  ISA_FMT_MEM,        UOP_SW,       3,    0,  ISA_DST_RT,    4 ) \
+	X( LB,       "LB",       ISA_PRIMARY,  0x20,  0x00,  ISA_FMT_MEM,        UOP_LB,       2,    1,  ISA_DST_RT,    1 ) \
+	X( LH,       "LH",       ISA_PRIMARY,  0x21,  0x00,  ISA_FMT_MEM,        UOP_LH,       2,    1,  ISA_DST_RT,    2 ) \
+	X( LW,       "LW",       ISA_PRIMARY,  0x23,  0x00,  ISA_FMT_MEM,        UOP_LW,       2,    1,  ISA_DST_RT,    4 ) \
+	X( BEQ,      "BEQ",      ISA_PRIMARY,  0x04,  0x00,  ISA_FMT_RS_RT_OFF,  UOP_BEQ,      6,    0,  ISA_DST_NONE,  4 ) \
+	X( BNE,      "BNE",      ISA_PRIMARY,  0x05,  0x00,  ISA_FMT_RS_RT_OFF,  UOP_BNE,      6,    0,  ISA_DST_NONE,  4 ) \
+	X( BLEZ,     "BLEZ",     ISA_PRIMARY,  0x06,  0x00,  ISA_FMT_RS_OFF,     UOP_BLEZ,     6,    0,  ISA_DST_NONE,  4 ) \
+	X( BGTZ,     "BGTZ",     ISA_PRIMARY,  0x07,  0x00,  ISA_FMT_RS_OFF,     UOP_BGTZ,     6,    0,  ISA_DST_NONE,  4 ) \
+	X( BLTZ,     "BLTZ",     ISA_REGIMM,   0x01,  0x00,  ISA_FMT_RS_OFF,     UOP_BLTZ,     6,    0,  ISA_DST_NONE,  4 ) \
+	X( BGEZ,     "BGEZ",     ISA_REGIMM,   0x01,  0x01,  ISA_FMT_RS_OFF,     UOP_BGEZ,     6,    0,  ISA_DST_NONE,  4 )
+
+/* Which field of the word selects the row */
+#define ISA_PRIMARY 0
+#define ISA_SPECIAL 1
+#define ISA_REGIMM  2
+
+/* Field holding the destination register */
+#define ISA_DST_NONE 0
+#define ISA_DST_RD   1
+#define ISA_DST_RT   2
+
+/* Operand layouts, written as the assembler reads them */
+#define ISA_FMT_NONE       0 //syscall
+#define ISA_FMT_RRR        1 //rd, rs, rt
+#define ISA_FMT_RR         2 //rs, rt
+#define ISA_FMT_SHIFT      3 //rd, rt, sa
+#define ISA_FMT_RS         4 //rs
+#define ISA_FMT_RD         5 //rd
+#define ISA_FMT_RD_RS      6 //rd, rs
+#define ISA_FMT_TARGET     7 //target
+#define ISA_FMT_RT_RS_IMM  8 //rt, rs, imm
+#define ISA_FMT_RT_IMM     9 //rt, imm
+#define ISA_FMT_MEM        10 //rt, imm(rs)
+#define ISA_FMT_RS_RT_OFF  11 //rs, rt, offset
+#define ISA_FMT_RS_OFF     12 //rs, offset
+
+/* One index per row; ISA_UNKNOWN (0) stands for every unlisted encoding */
+#define ISA_ENUM( name, mnem, space, op, key, fmt, uop, type, wr, dst, size ) ISA_##name,
+enum { ISA_UNKNOWN = 0, ISA_TABLE( ISA_ENUM ) ISA_COUNT };
+#undef ISA_ENUM
+
+typedef struct IsaEncoding_Struct {
+
+  const char *mnem; //disassembler spelling, NULL for ISA_UNKNOWN
+  uint8_t space; //ISA_PRIMARY, ISA_SPECIAL or ISA_REGIMM
+  uint8_t op; //6-bit opcode
+  uint8_t key; //funct (SPECIAL) or rt (REGIMM) value, 0 otherwise
+  uint8_t fmt; //ISA_FMT_* operand layout
+
+} IsaEncoding;
+
+
+/***************************************************************/
+/* INSTRUCTION SET OBJECT                                      */
+/***************************************************************/
+#define ISA_ENCODE( name, mnem, space, op, key, fmt, uop, type, wr, dst, size ) [ISA_##name] = { mnem, space, op, key, fmt },
+const IsaEncoding ISA_ENCODING[ISA_COUNT] = { ISA_TABLE( ISA_ENCODE ) };
+#undef ISA_ENCODE
+
+/* Decode maps: opcode, SPECIAL funct or REGIMM rt to row index */
+#define ISA_MAP_PRIMARY( name, mnem, space, op, key, fmt, uop, type, wr, dst, size ) [ space == ISA_PRIMARY ? op : 64 ] = ISA_##name,
+#define ISA_MAP_SPECIAL( name, mnem, space, op, key, fmt, uop, type, wr, dst, size ) [ space == ISA_SPECIAL ? key : 64 ] = ISA_##name,
+#define ISA_MAP_REGIMM( name, mnem, space, op, key, fmt, uop, type, wr, dst, size ) [ space == ISA_REGIMM ? key : 64 ] = ISA_##name,
+const uint8_t ISA_PRIMARY_MAP[65] = { ISA_TABLE( ISA_MAP_PRIMARY ) };
+const uint8_t ISA_SPECIAL_MAP[65] = { ISA_TABLE( ISA_MAP_SPECIAL ) };
+const uint8_t ISA_REGIMM_MAP[65] = { ISA_TABLE( ISA_MAP_REGIMM ) };
+#undef ISA_MAP_PRIMARY
+#undef ISA_MAP_SPECIAL
+#undef ISA_MAP_REGIMM
+
+const char *const ISA_REG_NAMES[32] = {
+	"$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+	"$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+	"$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+	"$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra"
+};
+
+
+/***************************************************************/
+/* Table lookups, shared by the simulator and the assembler    */
+/***************************************************************/
+static inline int isa_lookup( uint32_t ins )
+{
+	uint32_t op = ins >> 26;
+
+	if( op == 0x00 )
+		return ISA_SPECIAL_MAP[ins & 0x3F];
+	if( op == 0x01 )
+		return ISA_REGIMM_MAP[( ins >> 16 ) & 0x1F];
+	return ISA_PRIMARY_MAP[op];
+}
+
+static inline uint32_t isa_encode( int index, uint32_t rs, uint32_t rt, uint32_t rd, uint32_t sa, uint32_t imm )
+{
+	const IsaEncoding *e = &ISA_ENCODING[index];
+	uint32_t ins = (uint32_t) e->op << 26;
+
+	if( e->fmt == ISA_FMT_TARGET )
+		return ins | ( imm & 0x03FFFFFF );
+
+	if( e->space == ISA_REGIMM )
+		rt = e->key;
+
+	ins |= ( rs & 0x1F ) << 21 | ( rt & 0x1F ) << 16;
+
+	if( e->space == ISA_SPECIAL )
+		return ins | ( rd & 0x1F ) << 11 | ( sa & 0x1F ) << 6 | e->key;
+	return ins | ( imm & 0xFFFF );
+}
+
+/* Disassemble ins into buf the way the simulator prints it; "" if unknown */
+static inline void isa_disasm( char *buf, size_t len, uint32_t ins )
+{
+	const IsaEncoding *e = &ISA_ENCODING[isa_lookup( ins )];
+	const char *rs = ISA_REG_NAMES[( ins >> 21 ) & 0x1F];
+	const char *rt = ISA_REG_NAMES[( ins >> 16 ) & 0x1F];
+	const char *rd = ISA_REG_NAMES[( ins >> 11 ) & 0x1F];
+	uint32_t sa = ( ins >> 6 ) & 0x1F;
+	uint32_t im = ins & 0xFFFF;
+
+	buf[0] = '\0';
+	switch( e->fmt )
+	{
+		case ISA_FMT_NONE:
+			if( e->mnem != NULL )
+				snprintf( buf, len, "%s", e->mnem );
+			break;
+		case ISA_FMT_RRR: snprintf( buf, len, "%s %s, %s, %s", e->mnem, rd, rs, rt ); break;
+		case ISA_FMT_RR: snprintf( buf, len, "%s %s, %s", e->mnem, rs, rt ); break;
+		case ISA_FMT_SHIFT: snprintf( buf, len, "%s %s, %s, 0x%x", e->mnem, rd, rt, sa ); break;
+		case ISA_FMT_RS: snprintf( buf, len, "%s %s", e->mnem, rs ); break;
+		case ISA_FMT_RD: snprintf( buf, len, "%s %s", e->mnem, rd ); break;
+		case ISA_FMT_RD_RS: snprintf( buf, len, "%s %s, %s", e->mnem, rd, rs ); break;
+		case ISA_FMT_TARGET: snprintf( buf, len, "%s %x", e->mnem, ins & 0x03FFFFFF ); break;
+		case ISA_FMT_RT_RS_IMM: snprintf( buf, len, "%s %s, %s, 0x%x", e->mnem, rt, rs, im ); break;
+		case ISA_FMT_RT_IMM: snprintf( buf, len, "%s %s, 0x%x", e->mnem, rt, im ); break;
+		case ISA_FMT_MEM: snprintf( buf, len, "%s %s, 0x%x(%s)", e->mnem, rt, im, rs ); break;
+		case ISA_FMT_RS_RT_OFF: snprintf( buf, len, "%s %s, %s, 0x%x", e->mnem, rs, rt, im ); break;
+		case ISA_FMT_RS_OFF: snprintf( buf, len, "%s %s, 0x%x", e->mnem, rs, im ); break;
+	}
+}
@@ -0,0 +1,40 @@
+/******************************************************************************/
+/* TEMPLATE JIT FOR HOT BLOCKS                                                */
+/******************************************************************************/
+/* On x86-64 hosts the functional engine compiles a block to host code once */
+/* it has been entered JIT_THRESHOLD times. Every micro-op is pasted in as  */
+/* a fixed instruction template; guest registers are read and written      */
+/* through a base pointer to CURRENT_STATE.REGS, and loads and stores call */
+/* the regular mem_read_* / mem_write_* accessors.                         */
+/*                                                                            */
+/* The compiled block returns the guest PC it exits to. After each memory   */
+/* access it returns early if a store hit text or a watchpoint fired.      */
+/* Blocks holding DIV, DIVU or SYSCALL stay interpreted, and so does        */
+/* everything on other hosts. Compiled code lives in one mmap'd buffer that */
+/* is reset together with the block cache. The buffer is never writable    */
+/* and executable at once: jit_compile() makes the pages it emits into     */
+/* read-write, then read-execute again before the code can run.           */
+/******************************************************************************/
+#define JIT_CODE_SIZE (1 << 20)
+#define JIT_OP_BYTES 96 //upper bound on the host code of one micro-op
+#define JIT_DEFAULT_THRESHOLD 16
+
+typedef uint32_t (*JitFn)(uint32_t *regs);
+
+
+/***************************************************************/
+/* JIT OBJECT                                                  */
+/***************************************************************/
+uint8_t *JIT_CODE; //host code buffer, NULL until the first compile (or if it cannot be mapped)
+uint32_t JIT_USED; //bytes of JIT_CODE in use
+uint32_t JIT_THRESHOLD = JIT_DEFAULT_THRESHOLD; //entries before a block is compiled, 0 = never
+
+uint64_t JIT_COMPILED; //blocks compiled since start
+uint64_t JIT_ENTRIES; //block entries that ran host code
+
+
+/***************************************************************/
+/* Function Declerations.                                      */
+/***************************************************************/
+JitFn jit_compile(Block *b);
+void jit_reset();
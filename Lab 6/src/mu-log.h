@@ -0,0 +1,60 @@
+/******************************************************************************/
+/* ASYNCHRONOUS TRACE LOG                                                     */
+/******************************************************************************/
+/* `log <file>` sends TRACE() output to a file written by a background       */
+/* thread instead of to stdout, so verbose runs no longer wait on the        */
+/* terminal or a pipe.                                                        */
+/*                                                                            */
+/* Each thread formats its records into its own LogBuffer (LOG_LOCAL) with   */
+/* no locking. Only when the buffer is full is it queued for the writer,    */
+/* which hands it to fwrite in one piece and returns it to the free list.  */
+/* The lock is therefore taken once per LOG_BUF_SIZE bytes. If the writer   */
+/* falls LOG_NUM_BUFS buffers behind, the producer waits for a free one and */
+/* the wait is counted.                                                     */
+/*                                                                            */
+/* `log -` or quitting flushes the buffers and joins the writer.            */
+/******************************************************************************/
+#define LOG_BUF_SIZE (1 << 20) //bytes per buffer
+#define LOG_NUM_BUFS 8 //buffers shared by producers and the writer
+
+typedef struct LogBuffer_Struct {
+
+  char data[LOG_BUF_SIZE];
+  size_t used;
+  struct LogBuffer_Struct *next; //next in the full queue or the free list
+
+} LogBuffer;
+
+typedef struct AsyncLog_Struct {
+
+  FILE *fp;
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t ready; //signalled when a buffer is queued or the log stops
+  pthread_cond_t freed; //signalled when the writer returns a buffer
+
+  LogBuffer *full_head, *full_tail; //buffers waiting for the writer, oldest first
+  LogBuffer *free_list;
+  LogBuffer *all[LOG_NUM_BUFS];
+  int stopping; //TRUE once log_close() asked the writer to finish
+
+  uint64_t bytes; //bytes written to fp
+  uint64_t waits; //times a producer found no free buffer
+
+} AsyncLog;
+
+
+/***************************************************************/
+/* LOG OBJECT                                                  */
+/***************************************************************/
+AsyncLog LOG;
+int LOG_ACTIVE; //TRUE while TRACE() output goes to LOG.fp
+__thread LogBuffer *LOG_LOCAL; //buffer this thread is filling, NULL until its first record
+
+
+/***************************************************************/
+/* Function Declerations.                                      */
+/***************************************************************/
+int log_open(const char *path);
+void log_close();
+void log_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
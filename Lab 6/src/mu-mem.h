@@ -0,0 +1,159 @@
+/******************************************************************************/
+/* SPARSE GUEST MEMORY                                                        */
+/******************************************************************************/
+/* Guest memory is split into 4 KB pages reached through a two-level table:   */
+/* the top 10 address bits pick a PageTable, the next 10 bits pick a page.    */
+/* Tables and pages are only allocated when a page is first written; reads   */
+/* of untouched memory are served from a single shared zero page.            */
+/*                                                                            */
+/* mem_snapshot() freezes the current pages as a pristine image. Later       */
+/* writes copy the touched page first (copy-on-write) and remember it in a   */
+/* dirty list, so mem_restore() only has to drop those copies.               */
+/*                                                                            */
+/* mem_map_image() backs a page-aligned range with an mmap'd file. A         */
+/* read-only image becomes the pristine copy of its pages and is shared with */
+/* every other simulator mapping the same file; a writable image is mapped   */
+/* MAP_SHARED so stores land in the file and survive reset().               */
+/*                                                                            */
+/* Pages overlapping a watchpoint carry MEM_PAGE_WATCH and are never loaded  */
+/* into a last-page entry, so only their accesses reach the slow path where  */
+/* the watchpoints are checked; all other pages run at full speed.           */
+/*                                                                            */
+/* Pages holding decoded or translated code carry MEM_PAGE_CODE and are    */
+/* likewise kept out of the write entry. A store to such a page takes the  */
+/* slow path, which drops exactly the decoded words and blocks it covers;  */
+/* stores to data pages never look at the code caches.                     */
+/*                                                                            */
+/* The slow paths also record in PAGE_TOUCH which pages were ever read or     */
+/* written. With the heatmap on, last-page entries are not filled so every   */
+/* access is counted in PAGE_ACCESSES.                                       */
+/******************************************************************************/
+#define MEM_PAGE_SHIFT 12
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK (MEM_PAGE_SIZE - 1)
+
+#define MEM_PT_BITS 10
+#define MEM_PT_ENTRIES (1 << MEM_PT_BITS)
+#define MEM_DIR_ENTRIES (1 << (32 - MEM_PAGE_SHIFT - MEM_PT_BITS))
+
+#define MEM_VPN(addr)       ( (addr) >> MEM_PAGE_SHIFT )
+#define MEM_DIR_INDEX(addr) ( (addr) >> (MEM_PAGE_SHIFT + MEM_PT_BITS) )
+#define MEM_PT_INDEX(addr)  ( ( (addr) >> MEM_PAGE_SHIFT ) & (MEM_PT_ENTRIES - 1) )
+
+#define MEM_PAGE_OWNED 0x01 //pages[i] is a private copy that may be written in place
+#define MEM_PAGE_FILE  0x02 //pages[i] lies in a writable file mapping: never freed or snapshotted
+#define MEM_PAGE_IMAGE 0x04 //snapshot[i] lies in a read-only file mapping: never freed
+#define MEM_PAGE_WATCH 0x08 //a watchpoint overlaps the page: never cached in a last-page entry
+#define MEM_PAGE_CODE  0x10 //words of the page are decoded: never cached in the write entry
+
+typedef struct PageTable_Struct {
+
+  uint32_t *pages[MEM_PT_ENTRIES]; //host page backing each guest page, NULL until the page is first written
+  uint32_t *snapshot[MEM_PT_ENTRIES]; //pristine copy captured by mem_snapshot(), NULL if it was all zero
+  uint8_t flags[MEM_PT_ENTRIES]; //MEM_PAGE_* bits
+
+} PageTable;
+
+typedef struct GuestMemory_Struct {
+
+  PageTable *dir[MEM_DIR_ENTRIES]; //one table per 4 MB of guest address space, NULL until something in it is written
+  uint32_t resident_pages; //number of host pages currently allocated, snapshot pages included
+  uint32_t peak_pages; //highest resident_pages seen
+  uint32_t num_tables; //PageTables allocated, including ones only holding watch/code flags
+  uint64_t peak_bytes; //highest host memory seen for pages and tables together
+
+  int has_snapshot; //TRUE once mem_snapshot() has captured an image
+  uint32_t *dirty; //guest page numbers made private since the last snapshot/restore
+  uint32_t num_dirty, max_dirty;
+
+} GuestMemory;
+
+
+/* Pages hold guest memory as host-endian 32-bit words, so an aligned word  */
+/* access is a plain uint32_t load. Bytes and halfwords find their lane in   */
+/* the word by XOR-ing the byte offset with these swizzles (0 on little-    */
+/* endian hosts). Image files and binary dumps use the same layout.         */
+#define MEM_PAGE_WORDS (MEM_PAGE_SIZE / 4)
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define MEM_BYTE_SWIZZLE 3
+#define MEM_HALF_SWIZZLE 2
+#else
+#define MEM_BYTE_SWIZZLE 0
+#define MEM_HALF_SWIZZLE 0
+#endif
+
+#define MEM_BYTE(page, offset) ( ((uint8_t *)(page))[(offset) ^ MEM_BYTE_SWIZZLE] )
+
+/* One-entry translation cache: the last guest page touched by an access */
+/* stream and its host page. Hits cost one compare and one host load.   */
+#define MEM_TLB_INVALID 0xFFFFFFFF
+
+typedef struct MemTLB_Struct {
+
+  uint32_t vpn; //guest page number held by this entry, MEM_TLB_INVALID when empty
+  uint32_t *page; //host page for vpn
+
+} MemTLB;
+
+
+/* Touched-page tracking */
+#define MEM_NUM_PAGES (1 << (32 - MEM_PAGE_SHIFT))
+#define MEM_TOUCH_READ  0x1
+#define MEM_TOUCH_WRITE 0x2
+
+/* Watchpoints on guest address ranges */
+#define MAX_WATCHPOINTS 16
+#define WATCH_READ  0x1
+#define WATCH_WRITE 0x2
+
+typedef struct Watchpoint_Struct {
+
+  uint32_t begin, end; //inclusive guest address range
+  int kind; //WATCH_READ and/or WATCH_WRITE
+
+} Watchpoint;
+
+
+/***************************************************************/
+/* GUEST MEMORY OBJECT                                         */
+/***************************************************************/
+GuestMemory GUEST_MEM;
+uint32_t ZERO_PAGE[MEM_PAGE_WORDS]; //shared backing for every page that has never been written
+
+MemTLB FETCH_TLB; //last page read by instruction fetch
+MemTLB READ_TLB;  //last page read by a data access
+MemTLB WRITE_TLB; //last page written, never points at ZERO_PAGE
+
+Watchpoint WATCHPOINTS[MAX_WATCHPOINTS];
+int NUM_WATCHPOINTS;
+int WATCH_HIT; //set when a watchpoint fires; run()/runAll() stop after the current cycle
+int WATCH_MUTED; //TRUE while L1Cache moves whole lines; MEM() reports the access itself
+
+uint8_t PAGE_TOUCH[MEM_NUM_PAGES]; //MEM_TOUCH_* bits of every guest page ever accessed
+uint32_t *PAGE_ACCESSES; //per-page access counts while the heatmap is on, NULL otherwise
+
+
+/***************************************************************/
+/* Function Declerations.                                      */
+/***************************************************************/
+uint32_t *mem_page_read(uint32_t address);
+uint32_t *mem_page_write(uint32_t address);
+void mem_release();
+void mem_snapshot();
+void mem_restore();
+int mem_map_image(const char *path, uint32_t address, int writable);
+int mem_watch_add(uint32_t begin, uint32_t end, int kind);
+void mem_watch_clear();
+void mem_watch_mark(uint32_t begin, uint32_t end, int set);
+void mem_code_mark(uint32_t address, int set);
+void mem_heatmap(int on);
+void mem_report();
+void mem_tlb_flush();
+uint32_t mem_fetch_32(uint32_t address);
+uint8_t mem_read_8(uint32_t address);
+uint16_t mem_read_16(uint32_t address);
+uint64_t mem_read_64(uint32_t address);
+void mem_write_8(uint32_t address, uint8_t value);
+void mem_write_16(uint32_t address, uint16_t value);
+void mem_write_64(uint32_t address, uint64_t value);
@@ -1,11 +1,31 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <pthread.h>
 
 #include "mu-mips.h"
 #include "mu-cache.h"
+#include "mu-mem.h"
+#include "mu-isa.h"
+#include "mu-decode.h"
+#include "mu-block.h"
+#include "mu-jit.h"
+#include "mu-batch.h"
+#include "mu-trace.h"
+#include "mu-event.h"
+#include "mu-pipeview.h"
+#include "mu-log.h"
+#include "mu-stats.h"
 //test
 
 
@@ -32,6 +52,32 @@ uint32_t extend_sign( uint32_t im )
 	return data;
 }      
 
+/***************************************************************/
+/* Pull the sign extended byte/halfword at addr out of the     */
+/* cached word holding it                                      */
+/***************************************************************/
+uint32_t lane_extract( uint32_t word, uint32_t addr, uint32_t size )
+{
+	uint32_t shift = ( addr & 0x3 ) * 8;
+
+	if( size == 1 )
+		return (int8_t)( word >> shift );
+	if( size == 2 )
+		return extend_sign( word >> shift );
+	return word;
+}
+
+/***************************************************************/
+/* Replace the byte/halfword at addr inside a cached word      */
+/***************************************************************/
+uint32_t lane_merge( uint32_t word, uint32_t addr, uint32_t size, uint32_t value )
+{
+	uint32_t shift = ( addr & 0x3 ) * 8;
+	uint32_t mask = ( size == 4 ) ? 0xFFFFFFFF : ( ( 1u << ( 8 * size ) ) - 1 ) << shift;
+
+	return ( word & ~mask ) | ( ( value << shift ) & mask );
+}
+
 
 /***************************************************************/
 /* Print out a list of commands available                                                                  */
@@ -41,12 +87,37 @@ void help() {
 	printf("\t**********MU-MIPS Help MENU**********\n\n");
 	printf("sim\t-- simulate program to completion \n");
 	printf("run <n>\t-- simulate program for <n> instructions\n");
+	printf("frun <n>\t-- execute <n> instructions functionally, block by block, skipping the pipeline (0 = to completion)\n");
+	printf("ff <n>\t-- fast-forward <n> instructions functionally, then continue in the pipeline with fresh stats\n");
+	printf("ffpc <addr>\t-- fast-forward until the PC reaches <addr>\n");
+	printf("ffwarm <0|1>\t-- fill L1Cache during fast-forward\n");
+	printf("fuse <0|1>\t-- frun fuses lui+ori, addiu+lw and slt+bne/beq pairs\n");
+	printf("batch <lanes> <infile|-> <addr> <outfile|-> [<max>]\t-- run <lanes> lockstep copies, each with its slice of <infile> at <addr>,\n");
+	printf("\t\tfor at most <max> instructions over all lanes (default %u, 0 = no limit)\n", BATCH_DEFAULT_MAX_INS);
+	printf("jit <n>\t-- frun compiles a block to host code after <n> entries (0 = never)\n");
+	printf("events <file|->\t-- record binary pipeline events to <file> for mu-trace-dump (- stops)\n");
+	printf("log <file|->\t-- write trace output to <file> from a background thread (- closes it)\n");
+	printf("trace <cats> <level>\t-- pipeline output for fetch,decode,exec,mem,cache,hazard or all: 0 off, 1 events, 2 detail\n");
+	printf("tfilter pc <start> <stop>\t-- trace and record only instructions with PC in [<start>..<stop>]\n");
+	printf("tfilter cycles <start> <end>\t-- trace and record only cycles in [<start>, <end>)\n");
+	printf("tfilter sample <n>\t-- trace and record one in every <n> instructions fetched\n");
+	printf("tfilter off\t-- trace the whole run again\n");
 	printf("rdump\t-- dump register values\n");
 	printf("reset\t-- clears all registers/memory and re-loads the program\n");
 	printf("input <reg> <val>\t-- set GPR <reg> to <val>\n");
 	printf("mdump <start> <stop>\t-- dump memory from <start> to <stop> address\n");
+	printf("mdumpb|mdumpx <start> <stop> <file>\t-- write memory to <file> as raw binary/hex words\n");
+	printf("mload|mloadx <start> <file>\t-- load a binary/hex file into memory at <start>\n");
+	printf("map <file> <addr>\t-- back memory at page-aligned <addr> with a read-only image file\n");
+	printf("mapw <file> <addr>\t-- same, but stores are written through to the file\n");
+	printf("watch <start> <stop> <r|w|rw>\t-- stop when memory in [<start>..<stop>] is read/changed\n");
+	printf("unwatch\t-- remove all watchpoints\n");
+	printf("mstat\t-- print the guest memory footprint\n");
+	printf("heatmap <0|1>\t-- count accesses per page for the footprint report\n");
 	printf("high <val>\t-- set the HI register to <val>\n");
 	printf("low <val>\t-- set the LO register to <val>\n");
+	printf("pipeview <file|->\t-- write a Konata pipeline view of the run to <file> (- closes it)\n");
+	printf("stats <file|-> <json|csv>\t-- write the run statistics to <file> on exit (- cancels)\n");
 	printf("print\t-- print the program loaded into memory\n");
 	printf("show\t-- print the current content of the pipeline registers\n");
 	printf("?\t-- display help menu\n");
@@ -55,458 +126,4083 @@ void help() {
 }
 
 /***************************************************************/
-/* Read a 32-bit word from memory                                                                            */
+/* Command-line flags                                           */
 /***************************************************************/
-uint32_t mem_read_32(uint32_t address)
+void usage(const char *name) {
+	printf("Usage: %s [-q] [-o <file>] [-s <script>] [-r | -n <cycles>] <input program>\n", name);
+	printf("  -s <script>\trun the commands in <script> (input, mload, run, rdump, mdump, ...)\n");
+	printf("  -r\t\tthen simulate to completion\n");
+	printf("  -n <cycles>\tthen simulate for <cycles> cycles\n");
+	printf("  -q\t\tprint no banner, menu, load messages or trace output\n");
+	printf("  -o <file>\twrite the run statistics to <file> on exit, as CSV if it ends in .csv, else JSON\n");
+	printf("With -s, -r or -n the simulator exits after the run, printing key=value stats;\n");
+	printf("the exit code is %d if the program reached SYSCALL, %d if it was still running.\n", EXIT_FINISHED, EXIT_STOPPED);
+	printf("Usage, load and out-of-memory errors exit with %d.\n\n", EXIT_ERROR);
+}
+
+/***************************************************************/
+/* Return the host page backing address for a read (never NULL) */
+/***************************************************************/
+uint32_t *mem_page_read(uint32_t address)
 {
-	int i;
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		if ( (address >= MEM_REGIONS[i].begin) &&  ( address <= MEM_REGIONS[i].end) ) {
-			uint32_t offset = address - MEM_REGIONS[i].begin;
-			return (MEM_REGIONS[i].mem[offset+3] << 24) |
-					(MEM_REGIONS[i].mem[offset+2] << 16) |
-					(MEM_REGIONS[i].mem[offset+1] <<  8) |
-					(MEM_REGIONS[i].mem[offset+0] <<  0);
-		}
+	PageTable *pt = GUEST_MEM.dir[MEM_DIR_INDEX(address)];
+	if ( pt == NULL || pt->pages[MEM_PT_INDEX(address)] == NULL ) {
+		return ZERO_PAGE;
 	}
-	return 0;
+	return pt->pages[MEM_PT_INDEX(address)];
 }
 
 /***************************************************************/
-/* Write a 32-bit word to memory                                                                                */
+/* Track the largest host footprint of pages plus page tables   */
 /***************************************************************/
-void mem_write_32(uint32_t address, uint32_t value)
+static void mem_note_peak()
 {
-	int i;
-	uint32_t offset;
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
-			offset = address - MEM_REGIONS[i].begin;
+	uint64_t bytes = (uint64_t) GUEST_MEM.resident_pages * MEM_PAGE_SIZE + (uint64_t) GUEST_MEM.num_tables * sizeof(PageTable);
 
-			MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
-			MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
-			MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
-			MEM_REGIONS[i].mem[offset+0] = (value >>  0) & 0xFF;
-		}
+	if (GUEST_MEM.resident_pages > GUEST_MEM.peak_pages) {
+		GUEST_MEM.peak_pages = GUEST_MEM.resident_pages;
+	}
+	if (bytes > GUEST_MEM.peak_bytes) {
+		GUEST_MEM.peak_bytes = bytes;
 	}
 }
 
 /***************************************************************/
-/* Execute one cycle                                                                                                              */
+/* Allocate the empty page table covering address              */
 /***************************************************************/
-void cycle() {                                                
-	handle_pipeline();
-	CURRENT_STATE = NEXT_STATE;
-	CYCLE_COUNT++;
+static PageTable *mem_table(uint32_t address)
+{
+	PageTable *pt = calloc(1, sizeof(PageTable));
+
+	if (pt == NULL) {
+		printf("Error: out of memory allocating page table for 0x%08x\n", address);
+		exit(EXIT_ERROR);
+	}
+	GUEST_MEM.dir[MEM_DIR_INDEX(address)] = pt;
+	GUEST_MEM.num_tables++;
+	mem_note_peak();
+	return pt;
 }
 
 /***************************************************************/
-/* Simulate MIPS for n cycles                                                                                       */
+/* Return the host page backing address for a write, allocating */
+/* it on first use and copying shared snapshot pages before the */
+/* first write. NULL if address is outside every region.       */
 /***************************************************************/
-void run(int num_cycles) {                                      
-	
-	if (RUN_FLAG == FALSE) {
-		printf("Simulation Stopped\n\n");
-		return;
+uint32_t *mem_page_write(uint32_t address)
+{
+	int i;
+	uint32_t index = MEM_PT_INDEX(address);
+	PageTable *pt = GUEST_MEM.dir[MEM_DIR_INDEX(address)];
+	uint32_t *page;
+
+	if ( pt != NULL && (pt->flags[index] & MEM_PAGE_OWNED) ) {
+		return pt->pages[index];
 	}
 
-	printf("Running simulator for %d cycles...\n\n", num_cycles);
-	int i;
-	for (i = 0; i < num_cycles; i++) {
-		if (RUN_FLAG == FALSE) {
-			printf("Simulation Stopped.\n\n");
-			break;
+	if ( pt == NULL || pt->pages[index] == NULL ) {
+		for (i = 0; i < NUM_MEM_REGION; i++) {
+			if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
+				break;
+			}
+		}
+		if (i == NUM_MEM_REGION) {
+			return NULL;
+		}
+	}
+
+	if (pt == NULL) {
+		pt = mem_table(address);
+	}
+
+	page = malloc(MEM_PAGE_SIZE);
+	if (page == NULL) {
+		printf("Error: out of memory allocating page for 0x%08x\n", address);
+		exit(EXIT_ERROR);
+	}
+	if (pt->pages[index] != NULL) {
+		memcpy(page, pt->pages[index], MEM_PAGE_SIZE);
+	} else {
+		memset(page, 0, MEM_PAGE_SIZE);
+	}
+	pt->pages[index] = page;
+	pt->flags[index] |= MEM_PAGE_OWNED;
+	GUEST_MEM.resident_pages++;
+	mem_note_peak();
+
+	if (GUEST_MEM.num_dirty == GUEST_MEM.max_dirty) {
+		GUEST_MEM.max_dirty = GUEST_MEM.max_dirty ? 2 * GUEST_MEM.max_dirty : 64;
+		GUEST_MEM.dirty = realloc(GUEST_MEM.dirty, GUEST_MEM.max_dirty * sizeof(uint32_t));
+		if (GUEST_MEM.dirty == NULL) {
+			printf("Error: out of memory tracking dirty pages\n");
+			exit(EXIT_ERROR);
 		}
-		cycle();
 	}
+	GUEST_MEM.dirty[GUEST_MEM.num_dirty++] = MEM_VPN(address);
+
+	/* a read entry may still map this page to ZERO_PAGE or the snapshot */
+	mem_tlb_flush();
+	return page;
 }
 
 /***************************************************************/
-/* simulate to completion                                                                                               */
+/* Free every page and page table, returning memory to all zero */
 /***************************************************************/
-void runAll() {                                                     
-	if (RUN_FLAG == FALSE) {
-		printf("Simulation Stopped.\n\n");
-		return;
-	}
+void mem_release()
+{
+	int i, j;
+	PageTable *pt;
 
-	printf("Simulation Started...\n\n");
-	while (RUN_FLAG){
-		cycle();
+	for (i = 0; i < MEM_DIR_ENTRIES; i++) {
+		pt = GUEST_MEM.dir[i];
+		if (pt == NULL) {
+			continue;
+		}
+		for (j = 0; j < MEM_PT_ENTRIES; j++) {
+			if ( (pt->flags[j] & MEM_PAGE_OWNED) && !(pt->flags[j] & MEM_PAGE_FILE) ) {
+				free(pt->pages[j]);
+			}
+			if ( !(pt->flags[j] & MEM_PAGE_IMAGE) ) {
+				free(pt->snapshot[j]);
+			}
+		}
+		free(pt);
+		GUEST_MEM.dir[i] = NULL;
+	}
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if (MEM_REGIONS[i].image != NULL) {
+			munmap(MEM_REGIONS[i].image, MEM_REGIONS[i].image_size);
+			MEM_REGIONS[i].image = NULL;
+		}
+	}
+	GUEST_MEM.resident_pages = 0;
+	GUEST_MEM.num_tables = 0;
+	GUEST_MEM.has_snapshot = FALSE;
+	GUEST_MEM.num_dirty = 0;
+
+	/* the page flags went with the tables */
+	for (i = 0; i < NUM_WATCHPOINTS; i++) {
+		mem_watch_mark(WATCHPOINTS[i].begin, WATCHPOINTS[i].end, TRUE);
 	}
-	printf("Simulation Finished.\n\n");
+	mem_tlb_flush();
+	decode_flush();
 }
 
-/***************************************************************/ 
-/* Dump a word-aligned region of memory to the terminal                              */
 /***************************************************************/
-void mdump(uint32_t start, uint32_t stop) {          
-	uint32_t address;
+/* Capture the current memory image as the pristine snapshot   */
+/***************************************************************/
+void mem_snapshot()
+{
+	int i, j;
+	PageTable *pt;
 
-	printf("-------------------------------------------------------------\n");
-	printf("Memory content [0x%08x..0x%08x] :\n", start, stop);
-	printf("-------------------------------------------------------------\n");
-	printf("\t[Address in Hex (Dec) ]\t[Value]\n");
-	for (address = start; address <= stop; address += 4){
-		printf("\t0x%08x (%d) :\t0x%08x\n", address, address, mem_read_32(address));
+	for (i = 0; i < MEM_DIR_ENTRIES; i++) {
+		pt = GUEST_MEM.dir[i];
+		if (pt == NULL) {
+			continue;
+		}
+		for (j = 0; j < MEM_PT_ENTRIES; j++) {
+			if ( !(pt->flags[j] & MEM_PAGE_OWNED) || (pt->flags[j] & MEM_PAGE_FILE) ) {
+				continue;
+			}
+			if (pt->snapshot[j] != NULL && !(pt->flags[j] & MEM_PAGE_IMAGE)) {
+				free(pt->snapshot[j]);
+				GUEST_MEM.resident_pages--;
+			}
+			/* the page is now shared with the snapshot until written again */
+			pt->snapshot[j] = pt->pages[j];
+			pt->flags[j] &= ~(MEM_PAGE_OWNED | MEM_PAGE_IMAGE);
+		}
 	}
-	printf("\n");
+	GUEST_MEM.has_snapshot = TRUE;
+	GUEST_MEM.num_dirty = 0;
+	mem_tlb_flush();
 }
 
 /***************************************************************/
-/* Dump current values of registers to the teminal                                              */   
+/* Return memory to the last snapshot, dropping dirtied pages  */
 /***************************************************************/
-void rdump() {                               
-	int i; 
-	printf("-------------------------------------\n");
-	printf("Dumping Register Content\n");
-	printf("-------------------------------------\n");
-	printf("# Instructions Executed\t: %u\n", INSTRUCTION_COUNT);
-	printf("# Cycles Executed\t: %u\n", CYCLE_COUNT);
-	printf("PC\t: 0x%08x\n", CURRENT_STATE.PC);
-	printf("-------------------------------------\n");
-	printf("[Register]\t[Value]\n");
-	printf("-------------------------------------\n");
-	for (i = 0; i < MIPS_REGS; i++){
-		printf("[R%d]\t: 0x%08x\n", i, CURRENT_STATE.REGS[i]);
+void mem_restore()
+{
+	uint32_t i, vpn;
+	PageTable *pt;
+
+	for (i = 0; i < GUEST_MEM.num_dirty; i++) {
+		vpn = GUEST_MEM.dirty[i];
+		pt = GUEST_MEM.dir[vpn >> MEM_PT_BITS];
+		/* replaced by a file mapping since it was dirtied */
+		if ( !(pt->flags[vpn & (MEM_PT_ENTRIES - 1)] & MEM_PAGE_OWNED) || (pt->flags[vpn & (MEM_PT_ENTRIES - 1)] & MEM_PAGE_FILE) ) {
+			continue;
+		}
+		free(pt->pages[vpn & (MEM_PT_ENTRIES - 1)]);
+		pt->pages[vpn & (MEM_PT_ENTRIES - 1)] = pt->snapshot[vpn & (MEM_PT_ENTRIES - 1)];
+		pt->flags[vpn & (MEM_PT_ENTRIES - 1)] &= ~MEM_PAGE_OWNED;
+		GUEST_MEM.resident_pages--;
 	}
-	printf("-------------------------------------\n");
-	printf("[HI]\t: 0x%08x\n", CURRENT_STATE.HI);
-	printf("[LO]\t: 0x%08x\n", CURRENT_STATE.LO);
-	printf("-------------------------------------\n");
+	GUEST_MEM.num_dirty = 0;
+	mem_tlb_flush();
+	decode_flush();
 }
 
 /***************************************************************/
-/* Read a command from standard input.                                                               */  
+/* Back the guest pages starting at address with the contents  */
+/* of the file at path. Read-only images are copied on write   */
+/* and restored by reset(); writable images are stores-through */
+/* to the file. Returns 0 on success, -1 on error.             */
 /***************************************************************/
-void handle_command() {                         
-	char buffer[20];
-	uint32_t start, stop, cycles;
-	uint32_t register_no;
-	int register_value;
-	int hi_reg_value, lo_reg_value;
+int mem_map_image(const char *path, uint32_t address, int writable)
+{
+	int fd, i;
+	uint32_t k, npages, vpn, index;
+	struct stat st;
+	uint8_t *image;
+	size_t size;
+	PageTable *pt;
+	mem_region_t *region = NULL;
+
+	if (address & MEM_PAGE_MASK) {
+		printf("Error: image address 0x%08x is not page aligned\n", address);
+		return -1;
+	}
 
-	printf("MU-MIPS SIM:> ");
+	fd = open(path, writable ? O_RDWR : O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+		printf("Error: Can't open memory image %s\n", path);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	npages = (st.st_size + MEM_PAGE_SIZE - 1) >> MEM_PAGE_SHIFT;
+	size = (size_t)npages << MEM_PAGE_SHIFT;
 
-	if (scanf("%s", buffer) == EOF){
-		exit(0);
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if ( address >= MEM_REGIONS[i].begin && address <= MEM_REGIONS[i].end &&
+				size - 1 <= MEM_REGIONS[i].end - address ) {
+			region = &MEM_REGIONS[i];
+		}
+	}
+	if (region == NULL || region->image != NULL) {
+		printf("Error: image %s does not fit in a free memory region at 0x%08x\n", path, address);
+		close(fd);
+		return -1;
 	}
 
-	switch(buffer[0]) {
-		case 'S':
-		case 's':
-			if (buffer[1] == 'h' || buffer[1] == 'H'){
-				show_pipeline();
-			}else {
-				runAll(); 
-			}
-			break;
-		case 'M':
-		case 'm':
-			if (scanf("%x %x", &start, &stop) != 2){
-				break;
-			}
-			mdump(start, stop);
-			break;
-		case '?':
-			help();
-			break;
-		case 'Q':
-		case 'q':
-			printf("**************************\n");
-			printf("Exiting MU-MIPS! Good Bye...\n");
-			printf("**************************\n");
-			exit(0);
-		case 'R':
-		case 'r':
-			if (buffer[1] == 'd' || buffer[1] == 'D'){
-				rdump();
-			}else if(buffer[1] == 'e' || buffer[1] == 'E'){
-				reset();
-			}
-			else {
-				if (scanf("%d", &cycles) != 1) {
-					break;
-				}
-				run(cycles);
-			}
-			break;
-		case 'I':
-		case 'i':
-			if (scanf("%u %i", &register_no, &register_value) != 2){
-				break;
-			}
-			CURRENT_STATE.REGS[register_no] = register_value;
-			NEXT_STATE.REGS[register_no] = register_value;
-			break;
-		case 'H':
-		case 'h':
-			if (scanf("%i", &hi_reg_value) != 1){
-				break;
-			}
-			CURRENT_STATE.HI = hi_reg_value; 
-			NEXT_STATE.HI = hi_reg_value; 
-			break;
-		case 'L':
-		case 'l':
-			if (scanf("%i", &lo_reg_value) != 1){
-				break;
-			}
-			CURRENT_STATE.LO = lo_reg_value;
-			NEXT_STATE.LO = lo_reg_value;
-			break;
-		case 'P':
-		case 'p':
-			print_program(); 
-			break;
-		case 'f':
-			if (scanf("%d", &ENABLE_FORWARDING) != 1) {
-				break;
-			}
-			ENABLE_FORWARDING == 0 ? printf("Forwarding OFF\n") : printf("Forwarding ON\n");
-			break;
-		default:
-			printf("Invalid Command.\n");
-			break;
+	image = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+			writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) {
+		printf("Error: Can't map memory image %s\n", path);
+		return -1;
 	}
+	region->image = image;
+	region->image_begin = address;
+	region->image_size = size;
+
+	for (k = 0; k < npages; k++) {
+		vpn = MEM_VPN(address) + k;
+		index = vpn & (MEM_PT_ENTRIES - 1);
+		pt = GUEST_MEM.dir[vpn >> MEM_PT_BITS];
+		if (pt == NULL) {
+			pt = mem_table(vpn << MEM_PAGE_SHIFT);
+		}
+
+		/* drop whatever backed the page before */
+		if ( (pt->flags[index] & MEM_PAGE_OWNED) && !(pt->flags[index] & MEM_PAGE_FILE) ) {
+			free(pt->pages[index]);
+			GUEST_MEM.resident_pages--;
+		}
+		if ( pt->snapshot[index] != NULL && !(pt->flags[index] & MEM_PAGE_IMAGE) ) {
+			free(pt->snapshot[index]);
+			GUEST_MEM.resident_pages--;
+		}
+
+		pt->pages[index] = (uint32_t *)(image + ((size_t)k << MEM_PAGE_SHIFT));
+		pt->flags[index] &= MEM_PAGE_WATCH;
+		if (writable) {
+			pt->snapshot[index] = NULL;
+			pt->flags[index] |= MEM_PAGE_OWNED | MEM_PAGE_FILE;
+		} else {
+			pt->snapshot[index] = pt->pages[index];
+			pt->flags[index] |= MEM_PAGE_IMAGE;
+		}
+	}
+
+	mem_tlb_flush();
+	decode_flush();
+	if (!QUIET) printf("Mapped %s (%u pages) at 0x%08x%s\n", path, npages, address, writable ? " (writable)" : "");
+	return 0;
 }
 
 /***************************************************************/
-/* reset registers/memory and reload program                                                    */
+/* Set or clear flag on every page of [begin, end]             */
 /***************************************************************/
-void reset() {   
-	int i;
-	/*reset registers*/
-	for (i = 0; i < MIPS_REGS; i++){
-		CURRENT_STATE.REGS[i] = 0;
+static void mem_page_mark(uint32_t begin, uint32_t end, uint8_t flag, int set)
+{
+	uint32_t vpn;
+	PageTable *pt;
+
+	for (vpn = MEM_VPN(begin); vpn <= MEM_VPN(end); vpn++) {
+		pt = GUEST_MEM.dir[vpn >> MEM_PT_BITS];
+		if (pt == NULL) {
+			if (!set) {
+				continue;
+			}
+			pt = mem_table(vpn << MEM_PAGE_SHIFT);
+		}
+		if (set) {
+			pt->flags[vpn & (MEM_PT_ENTRIES - 1)] |= flag;
+		} else {
+			pt->flags[vpn & (MEM_PT_ENTRIES - 1)] &= ~flag;
+		}
 	}
-	CURRENT_STATE.HI = 0;
-	CURRENT_STATE.LO = 0;
-	
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		memset(MEM_REGIONS[i].mem, 0, region_size);
+	mem_tlb_flush();
+}
+
+/***************************************************************/
+/* Set or clear MEM_PAGE_WATCH on every page of [begin, end]   */
+/***************************************************************/
+void mem_watch_mark(uint32_t begin, uint32_t end, int set)
+{
+	mem_page_mark(begin, end, MEM_PAGE_WATCH, set);
+}
+
+/***************************************************************/
+/* Set or clear MEM_PAGE_CODE on the page holding address      */
+/***************************************************************/
+void mem_code_mark(uint32_t address, int set)
+{
+	mem_page_mark(address, address, MEM_PAGE_CODE, set);
+}
+
+/***************************************************************/
+/* Watch [begin, end] for reads and/or writes                  */
+/***************************************************************/
+int mem_watch_add(uint32_t begin, uint32_t end, int kind)
+{
+	if (NUM_WATCHPOINTS == MAX_WATCHPOINTS || begin > end || kind == 0) {
+		printf("Error: can't add watchpoint [0x%08x..0x%08x]\n", begin, end);
+		return -1;
 	}
-	
-	/*load program*/
-	load_program();
-	
-	/*reset PC*/
-	INSTRUCTION_COUNT = 0;
-	CURRENT_STATE.PC =  MEM_TEXT_BEGIN;
-	NEXT_STATE = CURRENT_STATE;
-	RUN_FLAG = TRUE;
+	WATCHPOINTS[NUM_WATCHPOINTS].begin = begin;
+	WATCHPOINTS[NUM_WATCHPOINTS].end = end;
+	WATCHPOINTS[NUM_WATCHPOINTS].kind = kind;
+	mem_watch_mark(begin, end, TRUE);
+	if (!QUIET) printf("Watchpoint %d: [0x%08x..0x%08x]%s%s\n", NUM_WATCHPOINTS, begin, end,
+			(kind & WATCH_READ) ? " read" : "", (kind & WATCH_WRITE) ? " write" : "");
+	return NUM_WATCHPOINTS++;
 }
 
 /***************************************************************/
-/* Allocate and set memory to zero                                                                            */
+/* Remove every watchpoint                                     */
 /***************************************************************/
-void init_memory() {                                           
+void mem_watch_clear()
+{
 	int i;
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		MEM_REGIONS[i].mem = malloc(region_size);
-		memset(MEM_REGIONS[i].mem, 0, region_size);
+	for (i = 0; i < NUM_WATCHPOINTS; i++) {
+		mem_watch_mark(WATCHPOINTS[i].begin, WATCHPOINTS[i].end, FALSE);
 	}
+	NUM_WATCHPOINTS = 0;
+	WATCH_HIT = FALSE;
 }
 
-/**************************************************************/
-/* load program into memory                                                                                      */
-/**************************************************************/
-void load_program() {                   
-	FILE * fp;
-	int i, word;
-	uint32_t address;
+/***************************************************************/
+/* Turn per-page access counting on or off                     */
+/***************************************************************/
+void mem_heatmap(int on)
+{
+	if (on && PAGE_ACCESSES == NULL) {
+		PAGE_ACCESSES = calloc(MEM_NUM_PAGES, sizeof(uint32_t));
+		if (PAGE_ACCESSES == NULL) {
+			printf("Error: out of memory allocating the access heatmap\n");
+			return;
+		}
+	} else if (!on) {
+		free(PAGE_ACCESSES);
+		PAGE_ACCESSES = NULL;
+	}
+	/* cached pages would bypass the counters */
+	mem_tlb_flush();
+}
 
-	/* Open program file. */
-	fp = fopen(prog_file, "r");
+/***************************************************************/
+/* Print touched, written and resident pages per region, the   */
+/* peak footprint and, if enabled, the per-page heatmap        */
+/***************************************************************/
+void mem_report()
+{
+	int i, bar;
+	uint32_t vpn, count, index;
+	uint32_t touched, written, resident, mapped;
+	PageTable *pt;
+
+	printf("-------------------------------------------------------------\n");
+	printf("Guest Memory Footprint (%d KB pages)\n", MEM_PAGE_SIZE / 1024);
+	printf("-------------------------------------------------------------\n");
+	printf("[Region]\t[Touched]\t[Written]\t[Resident]\t[Mapped]\n");
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		touched = written = resident = mapped = 0;
+		for (vpn = MEM_VPN(MEM_REGIONS[i].begin); vpn <= MEM_VPN(MEM_REGIONS[i].end); vpn++) {
+			touched += PAGE_TOUCH[vpn] != 0;
+			written += (PAGE_TOUCH[vpn] & MEM_TOUCH_WRITE) != 0;
+
+			pt = GUEST_MEM.dir[vpn >> MEM_PT_BITS];
+			if (pt == NULL) {
+				continue;
+			}
+			index = vpn & (MEM_PT_ENTRIES - 1);
+			resident += (pt->flags[index] & MEM_PAGE_OWNED) && !(pt->flags[index] & MEM_PAGE_FILE);
+			resident += pt->snapshot[index] != NULL && !(pt->flags[index] & MEM_PAGE_IMAGE);
+			mapped += (pt->flags[index] & (MEM_PAGE_FILE | MEM_PAGE_IMAGE)) != 0;
+		}
+		printf("%s\t\t%u\t\t%u\t\t%u\t\t%u\n", MEM_REGIONS[i].name, touched, written, resident, mapped);
+	}
+	printf("-------------------------------------------------------------\n");
+	printf("Resident\t: %u pages (%u KB) + %u page tables (%u KB)\n",
+			GUEST_MEM.resident_pages, GUEST_MEM.resident_pages * (MEM_PAGE_SIZE / 1024),
+			GUEST_MEM.num_tables, (uint32_t) (GUEST_MEM.num_tables * sizeof(PageTable) / 1024));
+	printf("Peak\t\t: %u pages, %llu KB with page tables\n", GUEST_MEM.peak_pages,
+			(unsigned long long) (GUEST_MEM.peak_bytes / 1024));
+	printf("-------------------------------------------------------------\n");
+
+	if (PAGE_ACCESSES == NULL) {
+		return;
+	}
+	printf("Page Access Heatmap (# ~ log2 accesses)\n");
+	printf("-------------------------------------------------------------\n");
+	for (vpn = 0; vpn < MEM_NUM_PAGES; vpn++) {
+		count = PAGE_ACCESSES[vpn];
+		if (count == 0) {
+			continue;
+		}
+		printf("0x%08x\t%10u  %c%c  ", vpn << MEM_PAGE_SHIFT, count,
+				(PAGE_TOUCH[vpn] & MEM_TOUCH_READ) ? 'R' : '-', (PAGE_TOUCH[vpn] & MEM_TOUCH_WRITE) ? 'W' : '-');
+		for (bar = 0; count != 0; count >>= 1, bar++) {
+			putchar('#');
+		}
+		putchar('\n');
+	}
+	printf("-------------------------------------------------------------\n");
+}
+
+/***************************************************************/
+/* Drop every cached translation                               */
+/***************************************************************/
+void mem_tlb_flush()
+{
+	FETCH_TLB.vpn = MEM_TLB_INVALID;
+	READ_TLB.vpn = MEM_TLB_INVALID;
+	WRITE_TLB.vpn = MEM_TLB_INVALID;
+}
+
+/***************************************************************/
+/* Load/store size bytes of guest data at a byte offset into a  */
+/* host page. size is a constant at every call so this folds   */
+/* down to a single host load or store.                        */
+/***************************************************************/
+static inline uint64_t mem_host_load(const uint32_t *page, uint32_t offset, int size)
+{
+	uint16_t v16;
+	uint64_t v64;
+
+	switch (size) {
+		case 1:
+			return MEM_BYTE(page, offset);
+		case 2:
+			memcpy(&v16, (const uint8_t *)page + (offset ^ MEM_HALF_SWIZZLE), 2);
+			return v16;
+		case 4:
+			return page[offset >> 2];
+		default:
+#if MEM_BYTE_SWIZZLE == 0
+			memcpy(&v64, (const uint8_t *)page + offset, 8);
+#else
+			v64 = page[offset >> 2] | ((uint64_t)page[(offset >> 2) + 1] << 32);
+#endif
+			return v64;
+	}
+}
+
+static inline void mem_host_store(uint32_t *page, uint32_t offset, int size, uint64_t value)
+{
+	uint16_t v16;
+
+	switch (size) {
+		case 1:
+			MEM_BYTE(page, offset) = value;
+			break;
+		case 2:
+			v16 = value;
+			memcpy((uint8_t *)page + (offset ^ MEM_HALF_SWIZZLE), &v16, 2);
+			break;
+		case 4:
+			page[offset >> 2] = value;
+			break;
+		default:
+#if MEM_BYTE_SWIZZLE == 0
+			memcpy((uint8_t *)page + offset, &value, 8);
+#else
+			page[offset >> 2] = value;
+			page[(offset >> 2) + 1] = value >> 32;
+#endif
+			break;
+	}
+}
+
+/***************************************************************/
+/* Read size bytes a byte at a time, bypassing the tlb and any  */
+/* watchpoints                                                 */
+/***************************************************************/
+static uint64_t mem_peek(uint32_t address, int size)
+{
+	int i;
+	uint64_t value = 0;
+
+	for (i = size - 1; i >= 0; i--) {
+		value = (value << 8) | MEM_BYTE(mem_page_read(address + i), (address + i) & MEM_PAGE_MASK);
+	}
+	return value;
+}
+
+/***************************************************************/
+/* TRUE if the access touches a page covered by a watchpoint   */
+/***************************************************************/
+static int mem_watched(uint32_t address, int size)
+{
+	PageTable *first = GUEST_MEM.dir[MEM_DIR_INDEX(address)];
+	PageTable *last = GUEST_MEM.dir[MEM_DIR_INDEX(address + size - 1)];
+
+	if (NUM_WATCHPOINTS == 0) {
+		return FALSE;
+	}
+	return (first != NULL && (first->flags[MEM_PT_INDEX(address)] & MEM_PAGE_WATCH)) ||
+		(last != NULL && (last->flags[MEM_PT_INDEX(address + size - 1)] & MEM_PAGE_WATCH));
+}
+
+/***************************************************************/
+/* TRUE if the access touches a page holding decoded code      */
+/***************************************************************/
+static int mem_has_code(uint32_t address, int size)
+{
+	PageTable *first = GUEST_MEM.dir[MEM_DIR_INDEX(address)];
+	PageTable *last = GUEST_MEM.dir[MEM_DIR_INDEX(address + size - 1)];
+
+	return (first != NULL && (first->flags[MEM_PT_INDEX(address)] & MEM_PAGE_CODE)) ||
+		(last != NULL && (last->flags[MEM_PT_INDEX(address + size - 1)] & MEM_PAGE_CODE));
+}
+
+/***************************************************************/
+/* Report an access that overlaps a watchpoint of its kind.    */
+/* Writes are only reported when they change memory.           */
+/***************************************************************/
+static void mem_watch_hit(uint32_t address, int size, int kind, uint64_t old, uint64_t value)
+{
+	int i;
+
+	if (WATCH_MUTED || (kind == WATCH_WRITE && old == value)) {
+		return;
+	}
+	for (i = 0; i < NUM_WATCHPOINTS; i++) {
+		if ( !(WATCHPOINTS[i].kind & kind) ||
+				address > WATCHPOINTS[i].end || address + size - 1 < WATCHPOINTS[i].begin ) {
+			continue;
+		}
+		if (!QUIET && kind == WATCH_WRITE) {
+			printf("\nWATCHPOINT %d: write 0x%08x [%d]: 0x%llx -> 0x%llx (cycle %u)\n", i, address, size,
+					(unsigned long long) old, (unsigned long long) value, CYCLE_COUNT);
+		} else if (!QUIET) {
+			printf("\nWATCHPOINT %d: read 0x%08x [%d]: 0x%llx (cycle %u)\n", i, address, size,
+					(unsigned long long) value, CYCLE_COUNT);
+		}
+		WATCH_HIT = TRUE;
+	}
+}
+
+/***************************************************************/
+/* Slow path of a read: refill tlb for aligned accesses, build  */
+/* unaligned or page-straddling values a byte at a time        */
+/***************************************************************/
+static uint64_t mem_read_slow(uint32_t address, int size, MemTLB *tlb)
+{
+	uint64_t value;
+	uint32_t *page;
+	int watched = (tlb == &READ_TLB) && mem_watched(address, size);
+
+	PAGE_TOUCH[MEM_VPN(address)] |= MEM_TOUCH_READ;
+	PAGE_TOUCH[MEM_VPN(address + size - 1)] |= MEM_TOUCH_READ;
+	if (PAGE_ACCESSES != NULL) {
+		PAGE_ACCESSES[MEM_VPN(address)]++;
+	}
+
+	if ( (address & (size - 1)) == 0 ) {
+		page = mem_page_read(address);
+		value = mem_host_load(page, address & MEM_PAGE_MASK, size);
+		if (!watched && PAGE_ACCESSES == NULL) {
+			tlb->vpn = MEM_VPN(address);
+			tlb->page = page;
+		}
+	} else {
+		value = mem_peek(address, size);
+	}
+
+	if (watched) {
+		mem_watch_hit(address, size, WATCH_READ, value, value);
+	}
+	return value;
+}
+
+/***************************************************************/
+/* Slow path of a write: allocate or copy pages as needed       */
+/***************************************************************/
+static void mem_write_slow(uint32_t address, int size, uint64_t value)
+{
+	int i;
+	uint32_t *page;
+	int watched = mem_watched(address, size);
+	int code = mem_has_code(address, size);
+	uint64_t old = watched ? mem_peek(address, size) : 0;
+
+	/* self-modifying code: drop the decoded words and blocks this store changes */
+	if (code && mem_peek(address, size) != value) {
+		decode_invalidate(address, size);
+	}
+
+	PAGE_TOUCH[MEM_VPN(address)] |= MEM_TOUCH_WRITE;
+	PAGE_TOUCH[MEM_VPN(address + size - 1)] |= MEM_TOUCH_WRITE;
+	if (PAGE_ACCESSES != NULL) {
+		PAGE_ACCESSES[MEM_VPN(address)]++;
+	}
+
+	/* storing zero into untouched pages changes nothing, keep them unallocated */
+	if (value == 0 && mem_page_read(address) == ZERO_PAGE && mem_page_read(address + size - 1) == ZERO_PAGE) {
+		return;
+	}
+
+	if ( (address & (size - 1)) == 0 ) {
+		page = mem_page_write(address);
+		if (page == NULL) {
+			return;
+		}
+		if (!watched && !code && PAGE_ACCESSES == NULL) {
+			WRITE_TLB.vpn = MEM_VPN(address);
+			WRITE_TLB.page = page;
+		}
+		mem_host_store(page, address & MEM_PAGE_MASK, size, value);
+	} else {
+		for (i = 0; i < size; i++) {
+			page = mem_page_write(address + i);
+			if (page != NULL) {
+				MEM_BYTE(page, (address + i) & MEM_PAGE_MASK) = (value >> (8*i)) & 0xFF;
+			}
+		}
+	}
+
+	if (watched) {
+		mem_watch_hit(address, size, WATCH_WRITE, old, value);
+	}
+}
+
+/***************************************************************/
+/* Read a byte/halfword/word/doubleword from memory. Aligned    */
+/* accesses to the last page read are a single host load.      */
+/***************************************************************/
+uint8_t mem_read_8(uint32_t address)
+{
+	if ( MEM_VPN(address) == READ_TLB.vpn ) {
+		return MEM_BYTE(READ_TLB.page, address & MEM_PAGE_MASK);
+	}
+	return mem_read_slow(address, 1, &READ_TLB);
+}
+
+uint16_t mem_read_16(uint32_t address)
+{
+	if ( MEM_VPN(address) == READ_TLB.vpn && (address & 0x1) == 0 ) {
+		return mem_host_load(READ_TLB.page, address & MEM_PAGE_MASK, 2);
+	}
+	return mem_read_slow(address, 2, &READ_TLB);
+}
+
+uint32_t mem_read_32(uint32_t address)
+{
+	if ( MEM_VPN(address) == READ_TLB.vpn && (address & 0x3) == 0 ) {
+		return mem_host_load(READ_TLB.page, address & MEM_PAGE_MASK, 4);
+	}
+	return mem_read_slow(address, 4, &READ_TLB);
+}
+
+uint64_t mem_read_64(uint32_t address)
+{
+	if ( MEM_VPN(address) == READ_TLB.vpn && (address & 0x7) == 0 ) {
+		return mem_host_load(READ_TLB.page, address & MEM_PAGE_MASK, 8);
+	}
+	return mem_read_slow(address, 8, &READ_TLB);
+}
+
+/***************************************************************/
+/* Read an instruction word; keeps its own last-page entry so   */
+/* sequential fetch is not evicted by data accesses            */
+/***************************************************************/
+uint32_t mem_fetch_32(uint32_t address)
+{
+	if ( MEM_VPN(address) == FETCH_TLB.vpn && (address & 0x3) == 0 ) {
+		return mem_host_load(FETCH_TLB.page, address & MEM_PAGE_MASK, 4);
+	}
+	return mem_read_slow(address, 4, &FETCH_TLB);
+}
+
+/***************************************************************/
+/* Write a byte/halfword/word/doubleword to memory. Aligned     */
+/* writes to the last page written are a single host store.    */
+/* Code pages never sit in WRITE_TLB, so stores into them reach */
+/* mem_write_slow() and drop the decoded copies of the words.  */
+/***************************************************************/
+void mem_write_8(uint32_t address, uint8_t value)
+{
+	if ( MEM_VPN(address) == WRITE_TLB.vpn ) {
+		MEM_BYTE(WRITE_TLB.page, address & MEM_PAGE_MASK) = value;
+		return;
+	}
+	mem_write_slow(address, 1, value);
+}
+
+void mem_write_16(uint32_t address, uint16_t value)
+{
+	if ( MEM_VPN(address) == WRITE_TLB.vpn && (address & 0x1) == 0 ) {
+		mem_host_store(WRITE_TLB.page, address & MEM_PAGE_MASK, 2, value);
+		return;
+	}
+	mem_write_slow(address, 2, value);
+}
+
+void mem_write_32(uint32_t address, uint32_t value)
+{
+	if ( MEM_VPN(address) == WRITE_TLB.vpn && (address & 0x3) == 0 ) {
+		mem_host_store(WRITE_TLB.page, address & MEM_PAGE_MASK, 4, value);
+		return;
+	}
+	mem_write_slow(address, 4, value);
+}
+
+void mem_write_64(uint32_t address, uint64_t value)
+{
+	if ( MEM_VPN(address) == WRITE_TLB.vpn && (address & 0x7) == 0 ) {
+		mem_host_store(WRITE_TLB.page, address & MEM_PAGE_MASK, 8, value);
+		return;
+	}
+	mem_write_slow(address, 8, value);
+}
+
+/***************************************************************/
+/* Execute one cycle                                                                                                              */
+/***************************************************************/
+void cycle() {                                                
+	if (TRACE_FILTER.windowed) {
+		TRACE_FILTER.in_window = CYCLE_COUNT - TRACE_FILTER.cycle_begin < TRACE_FILTER.cycle_end - TRACE_FILTER.cycle_begin;
+	}
+	handle_pipeline();
+	CURRENT_STATE = NEXT_STATE;
+	CYCLE_COUNT++;
+	STAT(CYCLES);
+}
+
+/***************************************************************/
+/* Simulate MIPS for n cycles                                                                                       */
+/***************************************************************/
+void run(int num_cycles) {                                      
+	
+	if (RUN_FLAG == FALSE) {
+		if (!QUIET) printf("Simulation Stopped\n\n");
+		return;
+	}
+
+	if (!QUIET) printf("Running simulator for %d cycles...\n\n", num_cycles);
+	int i;
+	for (i = 0; i < num_cycles; i++) {
+		if (RUN_FLAG == FALSE) {
+			if (!QUIET) printf("Simulation Stopped.\n\n");
+			break;
+		}
+		cycle();
+		if (WATCH_HIT) {
+			WATCH_HIT = FALSE;
+			if (!QUIET) printf("Stopped at watchpoint.\n\n");
+			break;
+		}
+	}
+}
+
+/***************************************************************/
+/* simulate to completion                                                                                               */
+/***************************************************************/
+void runAll() {                                                     
+	if (RUN_FLAG == FALSE) {
+		if (!QUIET) printf("Simulation Stopped.\n\n");
+		return;
+	}
+
+	if (!QUIET) printf("Simulation Started...\n\n");
+	while (RUN_FLAG){
+		cycle();
+		if (WATCH_HIT) {
+			WATCH_HIT = FALSE;
+			if (!QUIET) printf("Stopped at watchpoint.\n\n");
+			return;
+		}
+	}
+	if (!QUIET) printf("Simulation Finished.\n\n");
+}
+
+/***************************************************************/ 
+/* Dump a word-aligned region of memory to the terminal                              */
+/***************************************************************/
+void mdump(uint32_t start, uint32_t stop) {          
+	uint32_t address;
+
+	printf("-------------------------------------------------------------\n");
+	printf("Memory content [0x%08x..0x%08x] :\n", start, stop);
+	printf("-------------------------------------------------------------\n");
+	printf("\t[Address in Hex (Dec) ]\t[Value]\n");
+	for (address = start; address <= stop; address += 4){
+		printf("\t0x%08x (%d) :\t0x%08x\n", address, address, mem_read_32(address));
+	}
+	printf("\n");
+}
+
+/***************************************************************/
+/* Stream the words in [start..stop] to a file, as raw bytes in */
+/* page layout or as one hex word per line (the .in format)    */
+/***************************************************************/
+void mdump_file(uint32_t start, uint32_t stop, const char *path, int hex) {
+	static const char digits[] = "0123456789abcdef";
+	char line[MEM_PAGE_WORDS * 9];
+	uint32_t address, offset, len, word, i;
+	uint64_t remaining;
+	uint32_t *page;
+	FILE *fp;
+	int k, n;
+
+	start &= ~0x3;
+	stop &= ~0x3;
+	if (stop < start) {
+		printf("Error: empty memory range [0x%08x..0x%08x]\n", start, stop);
+		return;
+	}
+	fp = fopen(path, "wb");
 	if (fp == NULL) {
-		printf("Error: Can't open program file %s\n", prog_file);
-		exit(-1);
+		printf("Error: Can't open dump file %s\n", path);
+		return;
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+	address = start;
+	remaining = (uint64_t)stop - start + 4;
+	while (remaining > 0) {
+		offset = address & MEM_PAGE_MASK;
+		len = MEM_PAGE_SIZE - offset;
+		if (len > remaining) {
+			len = remaining;
+		}
+		page = mem_page_read(address);
+
+		if (hex) {
+			n = 0;
+			for (i = offset >> 2; i < (offset + len) >> 2; i++) {
+				word = page[i];
+				for (k = 28; k >= 0; k -= 4) {
+					line[n++] = digits[(word >> k) & 0xF];
+				}
+				line[n++] = '\n';
+			}
+			fwrite(line, 1, n, fp);
+		} else {
+			fwrite((uint8_t *)page + offset, 1, len, fp);
+		}
+		address += len;
+		remaining -= len;
+	}
+	fclose(fp);
+	if (!QUIET) printf("Memory [0x%08x..0x%08x] written to %s\n", start, stop, path);
+}
+
+/***************************************************************/
+/* Restore memory from a file written by mdump_file(), starting */
+/* at start. Bulk loads bypass watchpoints.                    */
+/***************************************************************/
+void mload(uint32_t start, const char *path, int hex) {
+	static uint8_t buf[MEM_PAGE_SIZE];
+	uint32_t address, offset, word, total = 0;
+	uint32_t *page;
+	size_t len, i;
+	int digits = 0, d;
+	FILE *fp;
+
+	start &= ~0x3;
+	fp = fopen(path, "rb");
+	if (fp == NULL) {
+		printf("Error: Can't open memory file %s\n", path);
+		return;
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+	address = start;
+	if (hex) {
+		word = 0;
+		while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+			for (i = 0; i < len; i++) {
+				if (buf[i] >= '0' && buf[i] <= '9') {
+					d = buf[i] - '0';
+				} else if ((buf[i] | 0x20) >= 'a' && (buf[i] | 0x20) <= 'f') {
+					d = (buf[i] | 0x20) - 'a' + 10;
+				} else {
+					/* skip an 0x prefix, otherwise end the current word */
+					if ((buf[i] | 0x20) == 'x' && digits == 1 && word == 0) {
+						digits = 0;
+					} else if (digits > 0) {
+						mem_write_32(address, word);
+						address += 4;
+						total += 4;
+						digits = 0;
+						word = 0;
+					}
+					continue;
+				}
+				if (++digits > 8) {
+					/* words already stored stay loaded; only this one is refused */
+					printf("Error: hex word at 0x%08x in %s has more than 8 digits\n", address, path);
+					fclose(fp);
+					decode_flush();
+					return;
+				}
+				word = (word << 4) | d;
+			}
+		}
+		if (digits > 0) {
+			mem_write_32(address, word);
+			total += 4;
+		}
+	} else {
+		offset = address & MEM_PAGE_MASK;
+		while ((len = fread(buf, 1, MEM_PAGE_SIZE - offset, fp)) > 0) {
+			if (mem_watched(address, len)) {
+				/* go through the store path so watchpoints see each word */
+				for (i = 0; i + 4 <= len; i += 4) {
+					memcpy(&word, buf + i, 4); //same byte order as the memcpy into a page below
+					mem_write_32(address + i, word);
+				}
+				for (; i < len; i++) {
+					mem_write_8(address + i, buf[i]);
+				}
+				address += len;
+				total += len;
+				offset = 0;
+				continue;
+			}
+
+			PAGE_TOUCH[MEM_VPN(address)] |= MEM_TOUCH_WRITE;
+			if (PAGE_ACCESSES != NULL) {
+				PAGE_ACCESSES[MEM_VPN(address)]++;
+			}
+			page = mem_page_read(address);
+			for (i = 0; page == ZERO_PAGE && i < len && buf[i] == 0; i++);
+
+			/* all-zero data over an untouched page stays unallocated */
+			if (page != ZERO_PAGE || i < len) {
+				page = mem_page_write(address);
+				if (page != NULL) {
+					memcpy((uint8_t *)page + offset, buf, len);
+				}
+			}
+			address += len;
+			total += len;
+			offset = 0;
+		}
+	}
+	fclose(fp);
+	decode_flush();
+	if (!QUIET) printf("%u bytes loaded into memory at 0x%08x from %s\n", total, start, path);
+}
+
+/***************************************************************/
+/* Dump current values of registers to the teminal                                              */   
+/***************************************************************/
+void rdump() {                               
+	int i; 
+	printf("-------------------------------------\n");
+	printf("Dumping Register Content\n");
+	printf("-------------------------------------\n");
+	printf("# Instructions Executed\t: %u\n", INSTRUCTION_COUNT);
+	printf("# Cycles Executed\t: %u\n", CYCLE_COUNT);
+	if (FF_INSTRUCTIONS) {
+		printf("# Fast-forwarded\t: %u\n", FF_INSTRUCTIONS);
+	}
+	printf("PC\t: 0x%08x\n", CURRENT_STATE.PC);
+	printf("-------------------------------------\n");
+	printf("[Register]\t[Value]\n");
+	printf("-------------------------------------\n");
+	for (i = 0; i < MIPS_REGS; i++){
+		printf("[R%d]\t: 0x%08x\n", i, CURRENT_STATE.REGS[i]);
+	}
+	printf("-------------------------------------\n");
+	printf("[HI]\t: 0x%08x\n", CURRENT_STATE.HI);
+	printf("[LO]\t: 0x%08x\n", CURRENT_STATE.LO);
+	printf("-------------------------------------\n");
+}
+
+/***************************************************************/
+/* Enable cats up to level and disable them above it (0 = off)  */
+/***************************************************************/
+void trace_set(uint32_t cats, int level) {
+	int l;
+
+	for (l = TRACE_INFO; l <= TRACE_DEBUG; l++) {
+		if (l <= level) {
+			TRACE_MASK[l] |= cats;
+		} else {
+			TRACE_MASK[l] &= ~cats;
+		}
+	}
+}
+
+/***************************************************************/
+/* Turn "fetch,mem" or "all" into TRACE_* bits; 0 if a name is  */
+/* unknown                                                      */
+/***************************************************************/
+uint32_t trace_parse(char *names) {
+	uint32_t cats = 0;
+	char *name;
+	int i;
+
+	for (name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+		if (strcasecmp(name, "all") == 0) {
+			cats |= TRACE_ALL;
+			continue;
+		}
+		for (i = 0; i < TRACE_NUM_CATS; i++) {
+			if (strcasecmp(name, TRACE_NAMES[i]) == 0) {
+				break;
+			}
+		}
+		if (i == TRACE_NUM_CATS) {
+			printf("Unknown trace category %s\n", name);
+			return 0;
+		}
+		cats |= 1 << i;
+	}
+	return cats;
+}
+
+/***************************************************************/
+/* Print the level each category is traced at                  */
+/***************************************************************/
+void trace_report() {
+	int i, level;
+
+	printf("Trace:");
+	for (i = 0; i < TRACE_NUM_CATS; i++) {
+		for (level = TRACE_DEBUG; level > TRACE_OFF; level--) {
+			if (TRACE_MASK[level] & (1 << i)) {
+				break;
+			}
+		}
+		printf(" %s=%d", TRACE_NAMES[i], level > TRACE_MAX_LEVEL ? TRACE_MAX_LEVEL : level);
+	}
+	printf("\n");
+}
+
+/***************************************************************/
+/* Apply the TRACE_FILTER fields set by `tfilter`               */
+/***************************************************************/
+void trace_filter_update() {
+	TRACE_FILTER.select = TRACE_FILTER.pc_begin != 0 || TRACE_FILTER.pc_end != 0xFFFFFFFF || TRACE_FILTER.sample > 1;
+	TRACE_FILTER.countdown = 0;
+	TRACE_FILTER.windowed = TRACE_FILTER.cycle_begin != 0 || TRACE_FILTER.cycle_end != 0;
+	TRACE_FILTER.in_window = !TRACE_FILTER.windowed ||
+		CYCLE_COUNT - TRACE_FILTER.cycle_begin < TRACE_FILTER.cycle_end - TRACE_FILTER.cycle_begin;
+	TRACE_PASS = TRUE;
+}
+
+/***************************************************************/
+/* Print the TRACE_FILTER settings                              */
+/***************************************************************/
+void trace_filter_report() {
+	if (!TRACE_FILTER.select && !TRACE_FILTER.windowed) {
+		printf("Trace filter: off\n");
+		return;
+	}
+	printf("Trace filter: pc 0x%08x..0x%08x, cycles ", TRACE_FILTER.pc_begin, TRACE_FILTER.pc_end);
+	TRACE_FILTER.windowed ? printf("%u..%u", TRACE_FILTER.cycle_begin, TRACE_FILTER.cycle_end) : printf("all");
+	printf(", 1 in %u\n", TRACE_FILTER.sample);
+}
+
+/***************************************************************/
+/* Clear the statistics registry                                */
+/***************************************************************/
+void stats_reset() {
+	memset(STATS, 0, sizeof(STATS));
+	memset(STATS_OP, 0, sizeof(STATS_OP));
+	MEM_WB_HELD = FALSE;
+}
+
+/***************************************************************/
+/* Cycles per committed instruction, 0 before the first commit  */
+/***************************************************************/
+double stats_cpi() {
+	return STATS[STAT_INSTRUCTIONS] ? (double) STATS[STAT_CYCLES] / STATS[STAT_INSTRUCTIONS] : 0.0;
+}
+
+/***************************************************************/
+/* Ask for the registry to be written to path on exit           */
+/***************************************************************/
+int stats_request(const char *path, const char *format) {
+	if (strcasecmp(format, "json") == 0) {
+		stats_format = STATS_JSON;
+	} else if (strcasecmp(format, "csv") == 0) {
+		stats_format = STATS_CSV;
+	} else {
+		printf("Unknown statistics format %s, use json or csv\n", format);
+		return FALSE;
+	}
+	if (strlen(path) >= sizeof(stats_file)) {
+		printf("Error: statistics path %s is too long\n", path);
+		return FALSE;
+	}
+	strcpy(stats_file, path);
+	return TRUE;
+}
+
+/***************************************************************/
+/* Write every counter, the CPI and the per-opcode commits to   */
+/* stats_file, if an export was requested                       */
+/***************************************************************/
+void stats_export() {
+	double cpi = stats_cpi();
+	const char *mnem;
+	FILE *fp;
+	int i, first = TRUE;
+
+	if (stats_file[0] == '\0') {
+		return;
+	}
+	fp = fopen(stats_file, "w");
+	if (fp == NULL) {
+		printf("Error: Can't write statistics to %s\n", stats_file);
+		return;
+	}
+
+	if (stats_format == STATS_CSV) {
+		fprintf(fp, "stat,value\n");
+		fprintf(fp, "status,%s\n", RUN_FLAG ? "stopped" : "finished");
+		for (i = 0; i < STAT_COUNT; i++) {
+			fprintf(fp, "%s,%llu\n", STAT_NAMES[i], (unsigned long long) STATS[i]);
+		}
+		fprintf(fp, "cpi,%.4f\n", cpi);
+		fprintf(fp, "fast_forwarded,%u\n", FF_INSTRUCTIONS);
+		for (i = 0; i < ISA_COUNT; i++) {
+			if (STATS_OP[i] != 0) {
+				mnem = ISA_ENCODING[i].mnem ? ISA_ENCODING[i].mnem : "UNKNOWN";
+				fprintf(fp, "op.%s,%llu\n", mnem, (unsigned long long) STATS_OP[i]);
+			}
+		}
+	} else {
+		fprintf(fp, "{\n");
+		fprintf(fp, "  \"program\": \"");
+		for (i = 0; prog_file[i] != '\0'; i++) {
+			if (prog_file[i] == '"' || prog_file[i] == '\\') {
+				fputc('\\', fp);
+			}
+			fputc(prog_file[i], fp);
+		}
+		fprintf(fp, "\",\n");
+		fprintf(fp, "  \"status\": \"%s\",\n", RUN_FLAG ? "stopped" : "finished");
+		for (i = 0; i < STAT_COUNT; i++) {
+			fprintf(fp, "  \"%s\": %llu,\n", STAT_NAMES[i], (unsigned long long) STATS[i]);
+		}
+		fprintf(fp, "  \"cpi\": %.4f,\n", cpi);
+		fprintf(fp, "  \"fast_forwarded\": %u,\n", FF_INSTRUCTIONS);
+		fprintf(fp, "  \"opcodes\": {");
+		for (i = 0; i < ISA_COUNT; i++) {
+			if (STATS_OP[i] != 0) {
+				mnem = ISA_ENCODING[i].mnem ? ISA_ENCODING[i].mnem : "UNKNOWN";
+				fprintf(fp, "%s\n    \"%s\": %llu", first ? "" : ",", mnem, (unsigned long long) STATS_OP[i]);
+				first = FALSE;
+			}
+		}
+		fprintf(fp, "%s}\n", first ? "" : "\n  ");
+		fprintf(fp, "}\n");
+	}
+	fclose(fp);
+	if (!QUIET) {
+		printf("Statistics written to %s\n", stats_file);
+	}
+}
+
+/***************************************************************/
+/* Close the trace outputs and exit, saying goodbye on quit.  */
+/* Non-interactive runs end with a key=value stats block and an */
+/* exit code saying whether the program reached SYSCALL.        */
+/***************************************************************/
+void sim_exit(int goodbye) {
+	stats_export();
+	event_close();
+	pipeview_close();
+	log_close();
+	if (!QUIET) {
+		mem_report();
+		if (goodbye) {
+			printf("**************************\n");
+			printf("Exiting MU-MIPS! Good Bye...\n");
+			printf("**************************\n");
+		}
+	}
+	if (INTERACTIVE) {
+		exit(0);
+	}
+
+	printf("status=%s\n", RUN_FLAG ? "stopped" : "finished");
+	printf("cycles=%llu\n", (unsigned long long) STATS[STAT_CYCLES]);
+	printf("instructions=%llu\n", (unsigned long long) STATS[STAT_INSTRUCTIONS]);
+	printf("cpi=%.4f\n", stats_cpi());
+	printf("fast_forwarded=%u\n", FF_INSTRUCTIONS);
+	printf("pc=0x%08x\n", CURRENT_STATE.PC);
+	printf("cache_hits=%u\n", cache_hits);
+	printf("cache_misses=%u\n", cache_misses);
+	fflush(stdout);
+	exit(RUN_FLAG ? EXIT_STOPPED : EXIT_FINISHED);
+}
+
+/***************************************************************/
+/* Read a command from CMD_IN (stdin or a -s script); FALSE     */
+/* once a script runs out.                                      */
+/***************************************************************/
+int handle_command() {                         
+	char buffer[20];
+	char path[256];
+	char out_path[256];
+	char line[64];
+	uint32_t start, stop, cycles;
+	uint32_t register_no;
+	int register_value;
+	int hi_reg_value, lo_reg_value;
+
+	if (INTERACTIVE) {
+		printf("MU-MIPS SIM:> ");
+	}
+
+	if (fscanf(CMD_IN, "%19s", buffer) == EOF){
+		if (INTERACTIVE) {
+			sim_exit(FALSE);
+		}
+		return FALSE;
+	}
+
+	switch(buffer[0]) {
+		case 'S':
+		case 's':
+			if (buffer[1] == 'h' || buffer[1] == 'H'){
+				show_pipeline();
+			}else if (buffer[1] == 't' || buffer[1] == 'T'){
+				if (fscanf(CMD_IN, "%255s", path) != 1) {
+					break;
+				}
+				if (strcmp(path, "-") == 0) {
+					stats_file[0] = '\0';
+					if (!QUIET) printf("Statistics export cancelled\n");
+				} else if (fscanf(CMD_IN, "%19s", buffer) == 1 && stats_request(path, buffer)) {
+					if (!QUIET) printf("Statistics will be written to %s on exit\n", path);
+				}
+			}else {
+				runAll(); 
+			}
+			break;
+		case 'M':
+		case 'm':
+			if (buffer[1] == 'a' || buffer[1] == 'A'){
+				if (fscanf(CMD_IN, "%255s %x", path, &start) != 2){
+					break;
+				}
+				mem_map_image(path, start, buffer[3] == 'w' || buffer[3] == 'W');
+				break;
+			}
+			if (buffer[1] == 's' || buffer[1] == 'S'){
+				mem_report();
+				break;
+			}
+			if (buffer[1] == 'l' || buffer[1] == 'L'){
+				if (fscanf(CMD_IN, "%x %255s", &start, path) != 2){
+					break;
+				}
+				mload(start, path, buffer[5] == 'x' || buffer[5] == 'X');
+				break;
+			}
+			if (fscanf(CMD_IN, "%x %x", &start, &stop) != 2){
+				break;
+			}
+			if (buffer[5] != '\0'){
+				if (fscanf(CMD_IN, "%255s", path) != 1){
+					break;
+				}
+				mdump_file(start, stop, path, buffer[5] == 'x' || buffer[5] == 'X');
+				break;
+			}
+			mdump(start, stop);
+			break;
+		case '?':
+			help();
+			break;
+		case 'Q':
+		case 'q':
+			sim_exit(TRUE);
+		case 'R':
+		case 'r':
+			if (buffer[1] == 'd' || buffer[1] == 'D'){
+				rdump();
+			}else if(buffer[1] == 'e' || buffer[1] == 'E'){
+				reset();
+			}
+			else {
+				if (fscanf(CMD_IN, "%d", &cycles) != 1) {
+					break;
+				}
+				run(cycles);
+			}
+			break;
+		case 'I':
+		case 'i':
+			if (fscanf(CMD_IN, "%u %i", &register_no, &register_value) != 2){
+				break;
+			}
+			CURRENT_STATE.REGS[register_no] = register_value;
+			NEXT_STATE.REGS[register_no] = register_value;
+			break;
+		case 'H':
+		case 'h':
+			if (buffer[1] == 'e' || buffer[1] == 'E'){
+				if (fscanf(CMD_IN, "%d", &register_value) != 1){
+					break;
+				}
+				mem_heatmap(register_value);
+				if (!QUIET) register_value ? printf("Heatmap ON\n") : printf("Heatmap OFF\n");
+				break;
+			}
+			if (fscanf(CMD_IN, "%i", &hi_reg_value) != 1){
+				break;
+			}
+			CURRENT_STATE.HI = hi_reg_value; 
+			NEXT_STATE.HI = hi_reg_value; 
+			break;
+		case 'L':
+		case 'l':
+			if ((buffer[1] == 'o' || buffer[1] == 'O') && (buffer[2] == 'g' || buffer[2] == 'G')){
+				if (fscanf(CMD_IN, "%255s", path) != 1){
+					break;
+				}
+				if (strcmp(path, "-") == 0){
+					log_close();
+				}else if (log_open(path)){
+					if (!QUIET) printf("Logging trace output to %s\n", path);
+				}
+				break;
+			}
+			if (fscanf(CMD_IN, "%i", &lo_reg_value) != 1){
+				break;
+			}
+			CURRENT_STATE.LO = lo_reg_value;
+			NEXT_STATE.LO = lo_reg_value;
+			break;
+		case 'P':
+		case 'p':
+			if (buffer[1] == 'i' || buffer[1] == 'I'){
+				if (fscanf(CMD_IN, "%255s", path) != 1){
+					break;
+				}
+				if (strcmp(path, "-") == 0){
+					pipeview_close();
+				}else if (pipeview_open(path)){
+					if (!QUIET) printf("Exporting the pipeline to %s\n", path);
+				}
+				break;
+			}
+			print_program(); 
+			break;
+		case 'W':
+		case 'w':
+			if (fscanf(CMD_IN, "%x %x %3s", &start, &stop, path) != 3){
+				break;
+			}
+			mem_watch_add(start, stop, (strchr(path, 'r') ? WATCH_READ : 0) | (strchr(path, 'w') ? WATCH_WRITE : 0));
+			break;
+		case 'E':
+		case 'e':
+			if (fscanf(CMD_IN, "%255s", path) != 1) {
+				break;
+			}
+			if (strcmp(path, "-") == 0) {
+				event_close();
+			} else if (event_open(path)) {
+				if (!QUIET) printf("Recording pipeline events to %s\n", path);
+			}
+			break;
+		case 'T':
+		case 't':
+			if (buffer[1] == 'f' || buffer[1] == 'F') {
+				if (fscanf(CMD_IN, "%255s", path) != 1) {
+					break;
+				}
+				if (strcasecmp(path, "pc") == 0) {
+					if (fscanf(CMD_IN, "%x %x", &start, &stop) != 2 || stop < start) {
+						break;
+					}
+					TRACE_FILTER.pc_begin = start;
+					TRACE_FILTER.pc_end = stop;
+				} else if (strcasecmp(path, "cycles") == 0) {
+					if (fscanf(CMD_IN, "%u %u", &start, &stop) != 2 || stop <= start) {
+						break;
+					}
+					TRACE_FILTER.cycle_begin = start;
+					TRACE_FILTER.cycle_end = stop;
+				} else if (strcasecmp(path, "sample") == 0) {
+					if (fscanf(CMD_IN, "%u", &cycles) != 1 || cycles == 0) {
+						break;
+					}
+					TRACE_FILTER.sample = cycles;
+				} else if (strcasecmp(path, "off") == 0) {
+					TRACE_FILTER.pc_begin = 0;
+					TRACE_FILTER.pc_end = 0xFFFFFFFF;
+					TRACE_FILTER.sample = 1;
+					TRACE_FILTER.cycle_begin = 0;
+					TRACE_FILTER.cycle_end = 0;
+				} else {
+					printf("Unknown trace filter %s\n", path);
+					break;
+				}
+				trace_filter_update();
+				if (!QUIET) trace_filter_report();
+				break;
+			}
+			if (fscanf(CMD_IN, "%255s %d", path, &register_value) != 2) {
+				break;
+			}
+			start = trace_parse(path);
+			if (start != 0) {
+				trace_set(start, register_value);
+				if (!QUIET) trace_report();
+			}
+			break;
+		case 'U':
+		case 'u':
+			mem_watch_clear();
+			if (!QUIET) printf("Watchpoints cleared\n");
+			break;
+		case 'B':
+		case 'b':
+			if (fscanf(CMD_IN, "%u %255s %x %255s", &cycles, path, &start, out_path) != 4) {
+				break;
+			}
+			//optional budget on the rest of the line
+			stop = BATCH_DEFAULT_MAX_INS;
+			if (fgets(line, sizeof(line), CMD_IN) != NULL) {
+				sscanf(line, "%u", &stop);
+			}
+			batch_run(cycles, path, start, out_path, stop);
+			break;
+		case 'J':
+		case 'j':
+			if (fscanf(CMD_IN, "%u", &JIT_THRESHOLD) != 1) {
+				break;
+			}
+			if (!QUIET) JIT_THRESHOLD == 0 ? printf("JIT OFF\n") : printf("JIT compiles blocks after %u entries\n", JIT_THRESHOLD);
+			break;
+		case 'f':
+			if (buffer[1] == 'f' || buffer[1] == 'F'){
+				if (buffer[2] == 'w' || buffer[2] == 'W'){
+					if (fscanf(CMD_IN, "%d", &FUNC_WARM_CACHE) != 1) {
+						break;
+					}
+					if (!QUIET) FUNC_WARM_CACHE ? printf("Fast-forward warms L1Cache\n") : printf("Fast-forward leaves L1Cache cold\n");
+				}else if (buffer[2] == 'p' || buffer[2] == 'P'){
+					if (fscanf(CMD_IN, "%x", &start) != 1) {
+						break;
+					}
+					fast_forward(0, start & ~0x3);
+				}else{
+					if (fscanf(CMD_IN, "%u", &cycles) != 1) {
+						break;
+					}
+					fast_forward(cycles, FUNC_NO_STOP);
+				}
+				break;
+			}
+			if (buffer[1] == 'r' || buffer[1] == 'R'){
+				if (fscanf(CMD_IN, "%u", &cycles) != 1) {
+					break;
+				}
+				frun(cycles, FUNC_NO_STOP);
+				break;
+			}
+			if (buffer[1] == 'u' || buffer[1] == 'U'){
+				if (fscanf(CMD_IN, "%d", &FUSE_ENABLED) != 1) {
+					break;
+				}
+				//rebuild blocks with the new setting
+				block_flush();
+				if (!QUIET) FUSE_ENABLED ? printf("Fusion ON\n") : printf("Fusion OFF\n");
+				break;
+			}
+			if (fscanf(CMD_IN, "%d", &ENABLE_FORWARDING) != 1) {
+				break;
+			}
+			if (!QUIET) ENABLE_FORWARDING == 0 ? printf("Forwarding OFF\n") : printf("Forwarding ON\n");
+			break;
+		default:
+			printf("Invalid Command.\n");
+			break;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* reset registers/memory and reload program                                                    */
+/***************************************************************/
+void reset() {   
+	int i;
+	/*reset registers*/
+	for (i = 0; i < MIPS_REGS; i++){
+		CURRENT_STATE.REGS[i] = 0;
+	}
+	CURRENT_STATE.HI = 0;
+	CURRENT_STATE.LO = 0;
+	
+	/*drop pages written since the program was loaded*/
+	if (GUEST_MEM.has_snapshot) {
+		mem_restore();
+	} else {
+		mem_release();
+		load_program();
+	}
+	
+	/*reset PC*/
+	INSTRUCTION_COUNT = 0;
+	FF_INSTRUCTIONS = 0;
+	stats_reset();
+	CURRENT_STATE.PC =  MEM_TEXT_BEGIN;
+	NEXT_STATE = CURRENT_STATE;
+	RUN_FLAG = TRUE;
+}
+
+/***************************************************************/
+/* Set memory to zero; pages are allocated lazily on first write */
+/***************************************************************/
+void init_memory() {                                           
+	mem_release(); //also empties the translation caches
+	memset(ZERO_PAGE, 0, MEM_PAGE_SIZE);
+}
+
+/**************************************************************/
+/* load program into memory                                                                                      */
+/**************************************************************/
+void load_program() {                   
+	FILE * fp;
+	int i, word;
+	uint32_t address;
+
+	/* Open program file. */
+	fp = fopen(prog_file, "r");
+	if (fp == NULL) {
+		printf("Error: Can't open program file %s\n", prog_file);
+		exit(EXIT_ERROR);
+	}
+
+	/* Read in the program. */
+
+	i = 0;
+	while( fscanf(fp, "%x\n", &word) != EOF ) {
+		address = MEM_TEXT_BEGIN + i;
+		mem_write_32(address, word);
+		if (!QUIET) printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
+		i += 4;
+	}
+	PROGRAM_SIZE = i/4;
+	if (!QUIET) printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
+	fclose(fp);
+
+	/* reset() returns to this image without re-reading the file */
+	mem_snapshot();
+}
+
+/************************************************************/
+/* maintain the pipeline                                                                                           */ 
+/************************************************************/
+void handle_pipeline()
+{
+	/*INSTRUCTION_COUNT should be incremented when instruction is done*/
+	/*Since we do not have branch/jump instructions, INSTRUCTION_COUNT should be incremented in WB stage */
+	
+	WB();
+	MEM();
+	EX();
+	ID();
+	IF();
+}
+
+/************************************************************/
+/* Let every in-flight instruction retire without fetching new ones,          */
+/* leaving CURRENT_STATE.PC at the next instruction to execute.                   */
+/************************************************************/
+void pipeline_drain()
+{
+	PIPE_DRAINING = 1;
+	while( RUN_FLAG && ( IF_ID.IR || ID_EX.IR || EX_MEM.IR || MEM_WB.IR || MEM_STALL ) )
+	{
+		cycle();
+	}
+	PIPE_DRAINING = 0;
+	CNT_STALL = 0;
+	TAKE_BRANCH = 0;
+	TAKE_JUMP = 0;
+}
+
+/************************************************************/
+/* Background writer: drain full log buffers until log_close()                           */ 
+/************************************************************/
+static void *log_writer( void *arg )
+{
+	LogBuffer *b;
+
+	pthread_mutex_lock( &LOG.lock );
+	while( TRUE )
+	{
+		while( LOG.full_head == NULL && !LOG.stopping )
+		{
+			pthread_cond_wait( &LOG.ready, &LOG.lock );
+		}
+		b = LOG.full_head;
+		if( b == NULL )
+		{
+			break;
+		}
+		LOG.full_head = b->next;
+		if( LOG.full_head == NULL )
+		{
+			LOG.full_tail = NULL;
+		}
+
+		//write without holding the lock so producers keep going
+		pthread_mutex_unlock( &LOG.lock );
+		fwrite( b->data, 1, b->used, LOG.fp );
+		pthread_mutex_lock( &LOG.lock );
+
+		LOG.bytes += b->used;
+		b->next = LOG.free_list;
+		LOG.free_list = b;
+		pthread_cond_signal( &LOG.freed );
+	}
+	pthread_mutex_unlock( &LOG.lock );
+	return NULL;
+}
+
+/* Give the calling thread an empty buffer, waiting for the writer if none is free */
+static LogBuffer *log_take()
+{
+	LogBuffer *b;
+
+	pthread_mutex_lock( &LOG.lock );
+	if( LOG.free_list == NULL )
+	{
+		++LOG.waits;
+	}
+	while( LOG.free_list == NULL )
+	{
+		pthread_cond_wait( &LOG.freed, &LOG.lock );
+	}
+	b = LOG.free_list;
+	LOG.free_list = b->next;
+	pthread_mutex_unlock( &LOG.lock );
+
+	b->used = 0;
+	b->next = NULL;
+	return b;
+}
+
+/* Queue a buffer for the writer */
+static void log_submit( LogBuffer *b )
+{
+	pthread_mutex_lock( &LOG.lock );
+	if( LOG.full_tail != NULL )
+	{
+		LOG.full_tail->next = b;
+	}
+	else
+	{
+		LOG.full_head = b;
+	}
+	LOG.full_tail = b;
+	b->next = NULL;
+	pthread_cond_signal( &LOG.ready );
+	pthread_mutex_unlock( &LOG.lock );
+}
+
+/************************************************************/
+/* Send TRACE() output to path through the writer thread                                   */ 
+/************************************************************/
+int log_open( const char *path )
+{
+	int i;
+
+	log_close();
+	memset( &LOG, 0, sizeof( LOG ) );
+	LOG.fp = fopen( path, "w" );
+	if( LOG.fp == NULL )
+	{
+		printf( "Error: Can't open log file %s\n", path );
+		return FALSE;
+	}
+
+	for( i = 0; i < LOG_NUM_BUFS; i++ )
+	{
+		LOG.all[i] = malloc( sizeof( LogBuffer ) );
+		if( LOG.all[i] == NULL )
+		{
+			printf( "Error: out of memory allocating log buffers\n" );
+			exit( EXIT_ERROR );
+		}
+		LOG.all[i]->next = LOG.free_list;
+		LOG.free_list = LOG.all[i];
+	}
+	pthread_mutex_init( &LOG.lock, NULL );
+	pthread_cond_init( &LOG.ready, NULL );
+	pthread_cond_init( &LOG.freed, NULL );
+
+	if( pthread_create( &LOG.writer, NULL, log_writer, NULL ) != 0 )
+	{
+		printf( "Error: Can't start the log writer thread\n" );
+		fclose( LOG.fp );
+		for( i = 0; i < LOG_NUM_BUFS; i++ )
+		{
+			free( LOG.all[i] );
+		}
+		return FALSE;
+	}
+	LOG_LOCAL = NULL;
+	LOG_ACTIVE = TRUE;
+	return TRUE;
+}
+
+/************************************************************/
+/* Flush what has been logged, stop the writer and close the file                        */ 
+/************************************************************/
+void log_close()
+{
+	int i;
+
+	if( !LOG_ACTIVE )
+	{
+		return;
+	}
+	LOG_ACTIVE = FALSE;
+
+	if( LOG_LOCAL != NULL && LOG_LOCAL->used > 0 )
+	{
+		log_submit( LOG_LOCAL );
+	}
+	LOG_LOCAL = NULL;
+
+	pthread_mutex_lock( &LOG.lock );
+	LOG.stopping = TRUE;
+	pthread_cond_signal( &LOG.ready );
+	pthread_mutex_unlock( &LOG.lock );
+	pthread_join( LOG.writer, NULL );
+
+	fclose( LOG.fp );
+	LOG.fp = NULL;
+	for( i = 0; i < LOG_NUM_BUFS; i++ )
+	{
+		free( LOG.all[i] );
+	}
+	pthread_mutex_destroy( &LOG.lock );
+	pthread_cond_destroy( &LOG.ready );
+	pthread_cond_destroy( &LOG.freed );
+	if( !QUIET )
+	{
+		printf( "%llu bytes logged, %llu waits for the writer\n", (unsigned long long) LOG.bytes, (unsigned long long) LOG.waits );
+	}
+}
+
+/************************************************************/
+/* Format one record into the calling thread's buffer                                          */ 
+/************************************************************/
+void log_printf( const char *format, ... )
+{
+	LogBuffer *b = LOG_LOCAL;
+	size_t room;
+	va_list args;
+	int n;
+
+	if( b == NULL )
+	{
+		b = LOG_LOCAL = log_take();
+	}
+
+	room = LOG_BUF_SIZE - b->used;
+	va_start( args, format );
+	n = vsnprintf( b->data + b->used, room, format, args );
+	va_end( args );
+
+	//did not fit: queue the full buffer and format the record again into a fresh one
+	if( n >= 0 && (size_t) n >= room )
+	{
+		log_submit( b );
+		b = LOG_LOCAL = log_take();
+		va_start( args, format );
+		n = vsnprintf( b->data, LOG_BUF_SIZE, format, args );
+		va_end( args );
+		if( n >= LOG_BUF_SIZE )
+		{
+			n = LOG_BUF_SIZE - 1;
+		}
+	}
+	if( n > 0 )
+	{
+		b->used += n;
+	}
+}
+
+/* Allocate the event ring on first use */
+static int event_ring()
+{
+	if( EVENTS.ring == NULL )
+	{
+		EVENTS.ring = malloc( EVENT_RING_SIZE * sizeof( PipeEvent ) );
+		if( EVENTS.ring == NULL )
+		{
+			printf( "Error: out of memory allocating the event ring\n" );
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/************************************************************/
+/* Start recording pipeline events to path, see mu-event.h                               */ 
+/************************************************************/
+int event_open( const char *path )
+{
+	PipeEventHeader header;
+
+	event_close();
+	if( !event_ring() )
+	{
+		return FALSE;
+	}
+
+	EVENTS.fp = fopen( path, "wb" );
+	if( EVENTS.fp == NULL )
+	{
+		printf( "Error: Can't open event file %s\n", path );
+		return FALSE;
+	}
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, EVENT_MAGIC, 4 );
+	header.version = EVENT_VERSION;
+	header.event_size = sizeof( PipeEvent );
+	fwrite( &header, sizeof( header ), 1, EVENTS.fp );
+
+	EVENTS.head = 0;
+	EVENTS.written = 0;
+	EVENTS.sinks |= EVENT_TO_FILE;
+	return TRUE;
+}
+
+/************************************************************/
+/* Hand every event not yet written to the file                                                */ 
+/************************************************************/
+void event_flush()
+{
+	uint32_t begin = EVENTS.written & ( EVENT_RING_SIZE - 1 );
+	uint64_t n = EVENTS.head - EVENTS.written;
+
+	if( EVENTS.fp == NULL || n == 0 )
+	{
+		return;
+	}
+
+	//the pending events may wrap around the end of the ring
+	if( begin + n > EVENT_RING_SIZE )
+	{
+		fwrite( &EVENTS.ring[begin], sizeof( PipeEvent ), EVENT_RING_SIZE - begin, EVENTS.fp );
+		n -= EVENT_RING_SIZE - begin;
+		begin = 0;
+	}
+	fwrite( &EVENTS.ring[begin], sizeof( PipeEvent ), n, EVENTS.fp );
+	EVENTS.written = EVENTS.head;
+}
+
+/************************************************************/
+/* Stop recording and close the event file                                                         */ 
+/************************************************************/
+void event_close()
+{
+	if( EVENTS.fp == NULL )
+	{
+		return;
+	}
+	event_flush();
+	fclose( EVENTS.fp );
+	EVENTS.fp = NULL;
+	EVENTS.sinks &= ~EVENT_TO_FILE;
+	if( !QUIET )
+	{
+		printf( "%llu pipeline events recorded\n", (unsigned long long) EVENTS.head );
+	}
+}
+
+/************************************************************/
+/* Export the pipeline to path as a Konata log, see mu-pipeview.h                    */ 
+/************************************************************/
+int pipeview_open( const char *path )
+{
+	FILE *fp;
+
+	pipeview_close();
+	if( !event_ring() )
+	{
+		return FALSE;
+	}
+	fp = fopen( path, "w" );
+	if( fp == NULL )
+	{
+		printf( "Error: Can't open pipeline view file %s\n", path );
+		return FALSE;
+	}
+	setvbuf( fp, NULL, _IOFBF, PV_BUF_SIZE );
+	pipeview_begin( &PIPEVIEW, fp );
+	EVENTS.sinks |= EVENT_TO_PIPEVIEW;
+	return TRUE;
+}
+
+void pipeview_close()
+{
+	FILE *fp = PIPEVIEW.fp;
+
+	if( fp == NULL )
+	{
+		return;
+	}
+	pipeview_end( &PIPEVIEW );
+	fclose( fp );
+	EVENTS.sinks &= ~EVENT_TO_PIPEVIEW;
+	if( !QUIET )
+	{
+		printf( "%llu instructions exported to the pipeline view\n", (unsigned long long) PIPEVIEW.next_id - 1 );
+	}
+}
+
+/* TRUE if TRACE_FILTER leaves out the instruction at pc; fetch counts it for sampling */
+static inline uint32_t trace_filtered( uint32_t pc, int fetch )
+{
+	uint32_t skip;
+
+	if( !TRACE_FILTER.select )
+	{
+		return FALSE;
+	}
+	if( pc - TRACE_FILTER.pc_begin > TRACE_FILTER.pc_end - TRACE_FILTER.pc_begin )
+	{
+		return TRUE;
+	}
+	skip = TRACE_FILTER.countdown != 0;
+	if( fetch )
+	{
+		TRACE_FILTER.countdown = skip ? TRACE_FILTER.countdown - 1 : TRACE_FILTER.sample - 1;
+	}
+	return skip;
+}
+
+/* Append one event; called through EVENT() so it costs nothing when off */
+static inline void event_record( uint8_t stage, uint8_t kind, uint8_t reason, uint8_t flags, uint32_t pc, uint32_t ir, uint32_t data )
+{
+	PipeEvent *e = &EVENTS.ring[EVENTS.head & ( EVENT_RING_SIZE - 1 )];
+
+	e->cycle = CYCLE_COUNT;
+	e->pc = pc;
+	e->ir = ir;
+	e->data = data;
+	e->stage = stage;
+	e->kind = kind;
+	e->reason = reason;
+	e->flags = flags;
+
+	if( EVENTS.sinks & EVENT_TO_PIPEVIEW )
+	{
+		pipeview_event( &PIPEVIEW, e );
+	}
+	if( ( EVENTS.sinks & EVENT_TO_FILE ) && ++EVENTS.head - EVENTS.written == EVENT_RING_SIZE )
+	{
+		event_flush();
+	}
+}
+
+/************************************************************/
+/* writeback (WB) pipeline stage:                                                                          */ 
+/************************************************************/
+void WB()
+{
+
+	//MEM_WB.RegWrite = EX_MEM.RegWrite;
+
+	uint32_t rt = MEM_WB.D.rt;
+	uint32_t rd = MEM_WB.D.rd;
+
+	TRACE_STAGE( MEM_WB );
+
+	//printf( "\n\nINS: %d", MEM_WB.type );
+	//print_instruction( MEM_WB.PC );
+	//printf( "\n\n" );
+
+	if( MEM_WB.type == 0 )
+	{
+		NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+		CURRENT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+
+		NEXT_STATE.HI = MEM_WB.HI;
+		NEXT_STATE.LO = MEM_WB.LO;
+		CURRENT_STATE.HI = MEM_WB.HI;
+		CURRENT_STATE.LO = MEM_WB.LO;
+
+	}
+	else if( MEM_WB.type == 1)
+	{
+		NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+		CURRENT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+	}
+	else if( MEM_WB.type == 2 )
+	{
+		NEXT_STATE.REGS[rt] = MEM_WB.LMD;
+		CURRENT_STATE.REGS[rt] = MEM_WB.LMD;
+		//printf( "\nLoaded %x\n", MEM_WB.LMD );
+	}
+	else if( MEM_WB.type == 3 )
+	{
+			TRACE( TRACE_MEM, TRACE_INFO, "\nWB UPDATE[%x]:\n"
+				"-> [0] = %u\n"
+				"-> [4] = %u\n"
+				"-> [8] = %u\n"
+				"-> [c] = %u\n", ( (MEM_WB.ALUOutput) ),
+				writeBuffer.words[0],writeBuffer.words[1],writeBuffer.words[2],writeBuffer.words[3]);
+
+		//the store was checked against watchpoints in MEM, not the line around it
+		WATCH_MUTED = TRUE;
+		mem_write_32( (MEM_WB.ALUOutput & 0xFFFFFFF0) + 0x0, writeBuffer.words[0] );
+		mem_write_32( (MEM_WB.ALUOutput & 0xFFFFFFF0) + 0x4, writeBuffer.words[1] );
+		mem_write_32( (MEM_WB.ALUOutput & 0xFFFFFFF0) + 0x8, writeBuffer.words[2] );
+		mem_write_32( (MEM_WB.ALUOutput & 0xFFFFFFF0) + 0xC, writeBuffer.words[3] );
+		WATCH_MUTED = FALSE;
+	}
+	else if( MEM_WB.type == 4)
+	{
+		//NEXT_STATE.REGS[0] = 0XA;
+		RUN_FLAG = FALSE;
+	}
+	else if( MEM_WB.type == 5)
+	{
+	}
+
+	EVENT( EV_WB, MEM_WB.IR ? EV_RUN : EV_BUBBLE, EV_REASON_NONE, 0, MEM_WB.PC, MEM_WB.IR,
+		MEM_WB.type == 2 ? MEM_WB.LMD : MEM_WB.ALUOutput );
+  	++INSTRUCTION_COUNT;
+	if( MEM_WB.IR != 0 && !MEM_WB_HELD )
+	{
+		STAT(INSTRUCTIONS);
+		++STATS_OP[MEM_WB.D.isa];
+	}
+}
+
+/************************************************************/
+/* memory access (MEM) pipeline stage:                                                          */ 
+/************************************************************/
+void MEM()
+{
+	TRACE_STAGE( EX_MEM );
+	if( MEM_STALL > 0 )
+	{
+		--MEM_STALL;
+		MEM_WB_HELD = TRUE;
+		STAT(CACHE_STALLS);
+		TRACE( TRACE_CACHE, TRACE_INFO, "MEM STAGE STALL : %d", MEM_STALL ); 
+		EVENT( EV_MEM, EV_STALL, EV_REASON_CACHE, 0, EX_MEM.PC, EX_MEM.IR, EX_MEM.ALUOutput );
+		return;
+	}
+
+	MEM_WB_HELD = FALSE;
+	MEM_WB.IR = EX_MEM.IR;
+	MEM_WB.PC = EX_MEM.PC;
+	MEM_WB.D = EX_MEM.D;
+	MEM_WB.Filtered = EX_MEM.Filtered;
+	MEM_WB.type = EX_MEM.type;
+	MEM_WB.RegisterRs = EX_MEM.RegisterRs;
+	MEM_WB.RegisterRt = EX_MEM.RegisterRt;
+	MEM_WB.RegisterRd = EX_MEM.RegisterRd;
+	MEM_WB.RegWrite = EX_MEM.RegWrite;
+	MEM_WB.DestReg = EX_MEM.DestReg;
+
+	MEM_WB.LO = EX_MEM.LO;
+	MEM_WB.HI = EX_MEM.HI;
+
+	TRACE( TRACE_CACHE, TRACE_DEBUG, "\nHITS: %d; MISSES: %d\n", cache_hits, cache_misses );
+
+	if(EX_MEM.type <= 1)		//0 reg-reg, 1 reg-imm
+	{
+		MEM_WB.ALUOutput = EX_MEM.ALUOutput;
+	}
+	else if(EX_MEM.type == 2)	//2 is Load
+	{
+		WATCH_MUTED = TRUE;
+		uint32_t index = ( EX_MEM.ALUOutput & 0x000000F0 ) >> 4;
+		uint32_t word_offset  = ( EX_MEM.ALUOutput & 0x0000000C ) >> 2;
+		uint32_t size = EX_MEM.D.size;
+		CacheBlock getBlock = L1Cache.blocks[index];
+
+		if( EX_MEM.CacheMiss == 0 )
+		{
+			//HIT
+			MEM_WB.LMD = lane_extract( getBlock.words[word_offset], EX_MEM.ALUOutput, size );
+		}
+		else
+		{
+			//MISS
+			if( size == 1 )
+			{
+				MEM_WB.LMD = (int8_t) mem_read_8( EX_MEM.ALUOutput );
+			}
+			else if( size == 2 )
+			{
+				MEM_WB.LMD = extend_sign( mem_read_16( EX_MEM.ALUOutput ) );
+			}
+			else
+			{
+				MEM_WB.LMD = mem_read_32( EX_MEM.ALUOutput );
+			}
+			getBlock.words[0] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x0 );
+			getBlock.words[1] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x4 );
+			getBlock.words[2] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x8 );
+			getBlock.words[3] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0xC );
+
+			MEM_STALL = 100;
+		}
+		WATCH_MUTED = FALSE;
+		if( mem_watched( EX_MEM.ALUOutput, size ) )
+		{
+			mem_watch_hit( EX_MEM.ALUOutput, size, WATCH_READ, MEM_WB.LMD, MEM_WB.LMD );
+		}
+	}
+	else if(EX_MEM.type == 3)	//3 is store
+	{
+		int index = ( EX_MEM.ALUOutput & 0x000000F0 ) >> 4;
+		int word_offset  = ( EX_MEM.ALUOutput & 0x0000000C ) >> 2;
+		uint32_t size = EX_MEM.D.size;
+		CacheBlock * getBlock = &L1Cache.blocks[index];
+
+		//memory changes in WB; report the store now, against what is there
+		if( mem_watched( EX_MEM.ALUOutput, size ) )
+		{
+			mem_watch_hit( EX_MEM.ALUOutput, size, WATCH_WRITE, mem_peek( EX_MEM.ALUOutput, size ),
+				size == 4 ? EX_MEM.B : EX_MEM.B & ( ( 1u << ( 8 * size ) ) - 1 ) );
+		}
+		WATCH_MUTED = TRUE;
+
+		if( EX_MEM.CacheMiss == 0 )
+		{
+			//HIT
+			getBlock->words[word_offset] = lane_merge( getBlock->words[word_offset], EX_MEM.ALUOutput, size, EX_MEM.B );
+			writeBuffer = *getBlock;
+			MEM_WB.ALUOutput = EX_MEM.ALUOutput;
+		}
+		else
+		{
+			//MISS
+			getBlock->words[0] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x0 );
+			getBlock->words[1] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x4 );
+			getBlock->words[2] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x8 );
+			getBlock->words[3] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0xC );
+			
+			getBlock->words[word_offset] = lane_merge( getBlock->words[word_offset], EX_MEM.ALUOutput, size, EX_MEM.B );
+
+			getBlock->tag = ( EX_MEM.ALUOutput & 0xFFFFFF00 );
+			getBlock->valid = 1;
+
+			writeBuffer = *getBlock;
+			MEM_WB.ALUOutput = EX_MEM.ALUOutput;
+		}
+		WATCH_MUTED = FALSE;
+	}
+	else if(EX_MEM.type == 6)
+	{
+		MEM_WB.ALUOutput = EX_MEM.ALUOutput;
+	}
+
+	EVENT( EV_MEM, EX_MEM.IR ? EV_RUN : EV_BUBBLE, EV_REASON_NONE,
+		( EX_MEM.type == 2 || EX_MEM.type == 3 ) ? ( EX_MEM.CacheMiss ? EV_FLAG_MISS : EV_FLAG_HIT ) : 0,
+		EX_MEM.PC, EX_MEM.IR, EX_MEM.ALUOutput );
+
+}
+
+/************************************************************/
+/* EX handlers: one per instruction, picked at decode time                                   */ 
+/************************************************************/
+
+/* Look the effective address up in L1Cache and flag a miss for MEM */
+static void ex_cache_check( uint32_t eAddr )
+{
+	uint32_t blocknum = ( eAddr & 0x000000F0 ) >> 4;
+	uint32_t tag 	  = ( eAddr & 0xFFFFFF00 );
+
+	CacheBlock * getBlock = &L1Cache.blocks[blocknum];
+	if( ( getBlock->tag == tag ) && ( getBlock->valid == 1 ) )
+	{
+		++cache_hits;
+		ID_EX.D.type == 2 ? STAT(LOAD_HITS) : STAT(STORE_HITS);
+		EX_MEM.CacheMiss = 0;
+	}
+	else
+	{
+		++cache_misses;
+		ID_EX.D.type == 2 ? STAT(LOAD_MISSES) : STAT(STORE_MISSES);
+		EX_MEM.CacheMiss = 1;
+	}
+}
+
+/* Redirect fetch to PC + offset of a taken conditional branch */
+static void ex_take_branch( int update_current )
+{
+	TAKE_BRANCH = 1;
+	uint32_t target = extend_sign( ID_EX.imm << 2 );
+	EX_MEM.ALUOutput = ( ID_EX.PC + target );
+	NEXT_STATE.PC = ( ID_EX.PC + target );
+	if( update_current )
+	{
+		CURRENT_STATE.PC = ( ID_EX.PC + target );
+	}
+}
+
+static void ex_unknown( const DecodedIns *d )
+{
+}
+
+static void ex_ADD( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Add Function\n" );
+	EX_MEM.ALUOutput = ID_EX.A + ID_EX.B;
+}
+
+static void ex_ADDU( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Add Unsigned Function\n" );
+	EX_MEM.ALUOutput = ID_EX.A + ID_EX.B;
+}
+
+static void ex_SUB( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Subtract Function\n" );
+	EX_MEM.ALUOutput = ID_EX.A - ID_EX.B;
+}
+
+static void ex_SUBU( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Subtract Unsigned Function\n" );
+	EX_MEM.ALUOutput = ID_EX.A - ID_EX.B;
+}
+
+static void ex_MULT( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Multiply Function\n" );
+	EX_MEM.ALUOutput = ID_EX.A * ID_EX.B;
+}
+
+static void ex_MULTU( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Multiply Unsigned Function\n" );
+	EX_MEM.ALUOutput = ID_EX.A * ID_EX.B;
+}
+
+static void ex_DIV( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Divide Function\n" );
+	EX_MEM.ALUOutput = ID_EX.A / ID_EX.B;
+	CNT_STALL += 2;
+}
+
+static void ex_DIVU( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Divide Unsigned Function\n" );
+	if( ID_EX.B == 0 )
+	{ 
+		puts( "ERROR: Trying to divide by 0" ); 
+	}
+	else
+	{
+		EX_MEM.ALUOutput = 0;
+		EX_MEM.HI = ID_EX.A % ID_EX.B ;
+		EX_MEM.LO = ID_EX.A / ID_EX.B ;
+	}
+	CNT_STALL += 2;
+}
+
+static void ex_AND( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "AND\n" );
+	EX_MEM.ALUOutput = ID_EX.A & ID_EX.B;
+}
+
+static void ex_OR( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "OR\n" );
+	EX_MEM.ALUOutput = ID_EX.A | ID_EX.B;
+}
+
+static void ex_XOR( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "XOR\n" );
+	EX_MEM.ALUOutput = ID_EX.A ^ ID_EX.B;
+}
+
+static void ex_NOR( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "NOR\n" );
+	EX_MEM.ALUOutput = ~( ID_EX.A | ID_EX.B );
+}
+
+static void ex_SLT( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "SLT\n" );
+	if( ID_EX.A < ID_EX.B )
+		EX_MEM.ALUOutput = 0x00000001;
+	else
+		EX_MEM.ALUOutput = 0x00000000;
+}
+
+static void ex_SLL( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "SLL\n" );
+	EX_MEM.ALUOutput = ID_EX.B << d->sa;
+}
+
+static void ex_SRL( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "SRL\n" );
+	EX_MEM.ALUOutput = ID_EX.B >> d->sa;
+}
+
+static void ex_SRA( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "SRA\n" );
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "\nB: %x\n", ID_EX.B );
+	EX_MEM.ALUOutput = extend_sign( ( ID_EX.B >> d->sa ) );
+}
+
+static void ex_SYSCALL( const DecodedIns *d )
+{
+	//SYSCALL - System Call, exit the program.                      
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "SYSCALL\n" );
+}
+
+static void ex_MTLO( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Move to LO\n" );
+	EX_MEM.LO = ID_EX.A;
+	NEXT_STATE.LO = ID_EX.A;
+}
+
+static void ex_MTHI( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Move to HI\n" );
+	EX_MEM.HI = ID_EX.A;
+	NEXT_STATE.HI = ID_EX.A;
+}
+
+static void ex_MFLO( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Move from LO\n" );
+	EX_MEM.ALUOutput = ID_EX.LO;  
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "\nLO VALUE: %x", ID_EX.LO ); 
+}
+
+static void ex_MFHI( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "Move from HI\n" );
+	EX_MEM.ALUOutput = ID_EX.HI;
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "\nHI VALUE: %x", ID_EX.HI );
+}
+
+static void ex_JR( const DecodedIns *d )
+{
+	TAKE_JUMP = 1;
+	CNT_STALL = 1;
+	uint32_t temp = ID_EX.A;
+		temp = 0x004000bc;
+	EX_MEM.ALUOutput = temp;
+	NEXT_STATE.PC = temp;
+}
+
+static void ex_JALR( const DecodedIns *d )
+{
+	TAKE_BRANCH = 1;
+	CNT_STALL = 1;
+	uint32_t temp = ID_EX.A;
+		temp = 0x00400090;
+	EX_MEM.ALUOutput = temp - CURRENT_STATE.PC;
+	NEXT_STATE.PC = temp;
+}
+
+static void ex_J( const DecodedIns *d )
+{
+	TAKE_JUMP = 1;
+	CNT_STALL = 1;
+
+	uint32_t bits = ( CURRENT_STATE.PC & 0xF0000000 );
+
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "\n\nJump INS:\n"
+		"Address: %x\n"
+		"CS.PC: %x\n", 
+		(bits | d->target), CURRENT_STATE.PC );
+	
+	NEXT_STATE.PC = (bits | d->target);
+	EX_MEM.ALUOutput = ( bits | d->target );
+}
+
+static void ex_JAL( const DecodedIns *d )
+{
+	TAKE_JUMP = 1;
+	CNT_STALL = 1;
+	uint32_t bits = ( CURRENT_STATE.PC & 0xF0000000 );
+	NEXT_STATE.PC = (bits | d->target);
+	EX_MEM.ALUOutput = ( bits | d->target );
+}
+
+static void ex_ADDI( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "ADDI\n" );
+	EX_MEM.ALUOutput =  ID_EX.imm + ID_EX.A;
+}
+
+static void ex_ADDIU( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "ADDIU\n" );
+	EX_MEM.ALUOutput =  ID_EX.imm + ID_EX.A;
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "\nEX->ADDIU: %s %s %u  \n", convert_Reg(d->rs), convert_Reg(d->rt), ID_EX.imm);
+}
+
+static void ex_SB( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "STORE BYTE\n" );
+	uint32_t eAddr = ID_EX.A + ID_EX.imm;              
+	EX_MEM.ALUOutput = eAddr;
+	EX_MEM.B = ID_EX.B;
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "\n%x | STOREBYTEDATA-> rt(B): %x; rs(A): %x", ID_EX.IR, ID_EX.B , ID_EX.A );						      
+	ex_cache_check( eAddr );
+}
+
+static void ex_SW( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "STORE WORD\n" );
+	uint32_t eAddr = ID_EX.A + ID_EX.imm;              
+	EX_MEM.ALUOutput = eAddr;
+	EX_MEM.B = ID_EX.B;
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "\n%x | STOREWORDDATA-> rt(B): %x; rs(A): %x", ID_EX.IR, ID_EX.B , ID_EX.A );
+	ex_cache_check( eAddr );
+}
+
+static void ex_SH( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "STORE HALFWORD\n" );
+	uint32_t eAddr = ID_EX.A +ID_EX.imm;  
+	EX_MEM.ALUOutput = eAddr;
+	EX_MEM.B = ID_EX.B;
+	ex_cache_check( eAddr );
+}
+
+static void ex_LW( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "LOAD WORD\n" );
+	uint32_t eAddr = ID_EX.A + ID_EX.imm;              
+	EX_MEM.ALUOutput = eAddr;
+	ex_cache_check( eAddr );
+}
+
+static void ex_LB( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "LOAD BYTE\n" );
+	uint32_t eAddr = ID_EX.A + ID_EX.imm;              
+	EX_MEM.ALUOutput = eAddr;
+	ex_cache_check( eAddr );
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "\n->> LoadByteFrom-> %x", eAddr );
+}
+
+static void ex_LH( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "LOAD HALFWORD\n" );
+	uint32_t eAddr = ID_EX.A + ID_EX.imm;              
+	EX_MEM.ALUOutput = eAddr;
+	ex_cache_check( eAddr );
+}
+
+static void ex_ANDI( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "ANDI\n" );
+	///zero extend immediate then and it with rs
+	EX_MEM.ALUOutput = (ID_EX.imm & 0x0000FFFF) & ID_EX.A;	
+}
+
+static void ex_LUI( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "LOAD IMMEDIATE UPPER\n" );
+	//Load data from instruction into rt register
+	EX_MEM.ALUOutput = (ID_EX.imm << 16);
+}
+
+static void ex_XORI( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "XORI\n" );
+	///zero extend immediate then and it with rs
+	EX_MEM.ALUOutput = (ID_EX.imm & 0x0000FFFF) ^ ID_EX.A;
+}
+
+static void ex_ORI( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "ORI\n" );
+	///zero extend immediate then and it with rs
+	EX_MEM.ALUOutput  = (ID_EX.imm & 0x0000FFFF) | ID_EX.A;	
+}
+
+static void ex_SLTI( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "SLTI\n" );
+	if( ID_EX.A < extend_sign( ID_EX.imm ) )
+		EX_MEM.ALUOutput = 0x00000001;
+	else
+		EX_MEM.ALUOutput = 0x00000000;
+}
+
+static void ex_BEQ( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "BEQ\n" );
+	if( ID_EX.A == ID_EX.B )
+	{
+		ex_take_branch( 0 );
+		TRACE( TRACE_EXEC, TRACE_INFO, "Taking Branch Equal\n" );
+	}
+	else
+	{
+		TAKE_BRANCH = 0;
+	}
+}
+
+static void ex_BNE( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "BNE\n" );
+	CNT_STALL = 1;
+	if( ID_EX.A != ID_EX.B )
+	{
+		ex_take_branch( 1 );
+		TRACE( TRACE_EXEC, TRACE_INFO, "Taking Branch NOT Equal\n" );
+	}
+	else
+	{
+		TAKE_BRANCH = 0;
+	}
+}
+
+static void ex_BLEZ( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "BLEZ\n" );
+	CNT_STALL = 1;
+	if( ( ID_EX.A & 0x80000000 ) || ( ID_EX.A == 0 ) )
+	{
+		ex_take_branch( 1 );
+		TRACE( TRACE_EXEC, TRACE_INFO, "Taking Branch Less Than Equal\n" );
+	}
+	else
+	{
+		TAKE_BRANCH = 0;
+	}
+}
+
+static void ex_BGTZ( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "BGTZ\n" );
+	CNT_STALL = 1;
+	if( !( ID_EX.A & 0x80000000 ) || ( ID_EX.A != 0 ) )
+	{
+		ex_take_branch( 1 );
+	}
+	else
+	{
+		TAKE_BRANCH = 0;
+	}
+}
+
+static void ex_BLTZ( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "BLTZ\n" );
+	CNT_STALL = 1;
+	if( ID_EX.A & 0x80000000 )
+	{
+		ex_take_branch( 1 );
+	}
+	else
+	{
+		TAKE_BRANCH = 0;
+	}
+}
+
+static void ex_BGEZ( const DecodedIns *d )
+{
+	TRACE( TRACE_EXEC, TRACE_DEBUG, "BGEZ\n" );
+	CNT_STALL = 1;
+	if( !( ID_EX.A & 0x80000000 ) )
+	{
+		ex_take_branch( 1 );
+	}
+	else
+	{
+		TAKE_BRANCH = 0;
+	}
+}
+
+/************************************************************/
+/* Decode an instruction word once: fields, class and EX handler                        */ 
+/************************************************************/
+#define ISA_EXEC_ROW( name, mnem, space, op, key, fmt, uop, type, wr, dst, size ) [ISA_##name] = { ex_##name, uop, type, wr, dst, size },
+static const IsaExec ISA_EXEC[ISA_COUNT] = {
+
+	//anything not listed in ISA_TABLE does nothing and writes nothing back
+	[ISA_UNKNOWN] = { ex_unknown, UOP_NOP, 5, 0, ISA_DST_NONE, 4 },
+	ISA_TABLE( ISA_EXEC_ROW )
+};
+#undef ISA_EXEC_ROW
+
+void decode_ins( DecodedIns *d, uint32_t ins )
+{
+	int isa = isa_lookup( ins );
+	const IsaExec *x = &ISA_EXEC[isa];
+
+	d->IR = ins;
+	d->opcode = ( 0xFC000000 & ins ) >> 26;
+	d->rs = ( 0x03E00000 & ins ) >> 21;
+	d->rt = ( 0x001F0000 & ins ) >> 16;
+	d->rd = ( 0x0000F800 & ins ) >> 11;
+	d->sa = ( 0x000007C0 & ins ) >> 6;
+	d->func = ( 0x0000003F & ins );
+	d->imm = extend_sign( 0x0000FFFF & ins );
+	d->target = ( 0x03FFFFFF & ins ) << 2;
+	d->valid = 1;
+
+	d->handler = x->handler;
+	d->isa = isa;
+	d->uop = x->uop;
+	d->type = x->type;
+	d->RegWrite = x->RegWrite;
+	d->size = x->size;
+	if( x->dst == ISA_DST_RD )
+		d->DestReg = d->rd;
+	else if( x->dst == ISA_DST_RT )
+		d->DestReg = d->rt;
+	else
+		d->DestReg = 0;
+}
+
+/************************************************************/
+/* Decoded instruction at pc, decoding the memory word on a miss                       */ 
+/************************************************************/
+const DecodedIns *decode_fetch( uint32_t pc )
+{
+	static DecodedIns uncached;
+	DecodedPage **slot;
+	DecodedIns *d;
+
+	if( !DECODE_IS_TEXT( pc ) || ( pc & 0x3 ) )
+	{
+		decode_ins( &uncached, mem_fetch_32( pc ) );
+		return &uncached;
+	}
+
+	slot = &DECODE_CACHE[ MEM_VPN( pc ) - MEM_VPN( MEM_TEXT_BEGIN ) ];
+	if( *slot == NULL )
+	{
+		*slot = calloc( 1, sizeof( DecodedPage ) );
+		if( *slot == NULL )
+		{
+			printf( "Error: out of memory allocating decode cache for 0x%08x\n", pc );
+			exit( EXIT_ERROR );
+		}
+		//stores into the page now take the slow path and invalidate
+		mem_code_mark( pc, TRUE );
+	}
+
+	d = &(*slot)->ins[ ( pc & MEM_PAGE_MASK ) >> 2 ];
+	if( !d->valid )
+	{
+		decode_ins( d, mem_fetch_32( pc ) );
+	}
+	return d;
+}
+
+/************************************************************/
+/* Forget decoded words overlapping [address, address + size)                             */ 
+/************************************************************/
+void decode_invalidate( uint32_t address, uint32_t size )
+{
+	uint32_t word;
+	DecodedPage *page;
+
+	for( word = address & ~0x3; word - ( address & ~0x3 ) < size + ( address & 0x3 ); word += 4 )
+	{
+		if( !DECODE_IS_TEXT( word ) )
+			continue;
+		page = DECODE_CACHE[ MEM_VPN( word ) - MEM_VPN( MEM_TEXT_BEGIN ) ];
+		if( page != NULL )
+			page->ins[ ( word & MEM_PAGE_MASK ) >> 2 ].valid = 0;
+	}
+	if( BLOCK_LIST != NULL )
+		block_invalidate( address, size );
+}
+
+/************************************************************/
+/* Forget every decoded word                                                                                */ 
+/************************************************************/
+void decode_flush()
+{
+	int i;
+	for( i = 0; i < DECODE_TEXT_PAGES; i++ )
+	{
+		if( DECODE_CACHE[i] != NULL )
+			mem_code_mark( MEM_TEXT_BEGIN + ( i << MEM_PAGE_SHIFT ), FALSE );
+		free( DECODE_CACHE[i] );
+		DECODE_CACHE[i] = NULL;
+	}
+	block_flush();
+}
+
+/************************************************************/
+/* Fuse adjacent idiom pairs in place; returns the number of pairs              */ 
+/************************************************************/
+static uint32_t block_fuse( MicroOp *ops, uint32_t n )
+{
+	uint32_t i, fused = 0;
+	MicroOp *u;
+
+	for( i = 0; i + 1 < n; i++ )
+	{
+		u = &ops[i];
+		//lui rX, hi; ori rY, rX, lo
+		if( u->op == UOP_LUI && u[1].op == UOP_ORI && u[1].rs == u->rt )
+			u->op = UOP_F_LUI_ORI;
+		//addiu rX, rA, i; lw rY, o(rX)
+		else if( u->op == UOP_ADDI && u[1].op == UOP_LW && u[1].rs == u->rt )
+			u->op = UOP_F_ADDI_LW;
+		//slt rX, rA, rB; bne/beq rX, ...
+		else if( u->op == UOP_SLT && ( u[1].op == UOP_BNE || u[1].op == UOP_BEQ ) && ( u[1].rs == u->rd || u[1].rt == u->rd ) )
+			u->op = UOP_F_SLT_BR;
+		else
+			continue;
+
+		//the second half is never fused again
+		++fused;
+		++i;
+	}
+	return fused;
+}
+
+/************************************************************/
+/* Translate the basic block starting at pc into micro-ops                              */ 
+/************************************************************/
+static Block *block_translate( uint32_t pc, Block *into )
+{
+	MicroOp ops[BLOCK_MAX_OPS];
+	const DecodedIns *d;
+	MicroOp *u;
+	uint32_t n = 0, a = pc, fused;
+	Block *b;
+
+	do
+	{
+		d = decode_fetch( a );
+		u = &ops[n++];
+		u->op = d->uop;
+		u->rs = d->rs;
+		u->rt = d->rt;
+		u->rd = d->rd;
+		u->imm = d->imm;
+
+		//fold each immediate into the form its micro-op consumes, as EX computes it
+		switch( u->op )
+		{
+			case UOP_SLL: case UOP_SRL: case UOP_SRA: u->imm = d->sa; break;
+			case UOP_ANDI: case UOP_ORI: case UOP_XORI: u->imm = d->imm & 0x0000FFFF; break;
+			case UOP_LUI: u->imm = d->imm << 16; break;
+			case UOP_BEQ: case UOP_BNE: case UOP_BLEZ:
+			case UOP_BGTZ: case UOP_BLTZ: case UOP_BGEZ: u->imm = a + extend_sign( d->imm << 2 ); break;
+			case UOP_J: u->imm = ( a & 0xF0000000 ) | d->target; break;
+			//EX sends every JR/JALR to a fixed address
+			case UOP_JR: u->imm = 0x004000bc; break;
+			case UOP_JALR: u->imm = 0x00400090; break;
+		}
+		a += 4;
+	} while( !UOP_ENDS_BLOCK( u->op ) && n < BLOCK_MAX_OPS && ( a & MEM_PAGE_MASK ) != 0 );
+
+	fused = FUSE_ENABLED ? block_fuse( ops, n ) : 0;
+
+	b = into;
+	if( b == NULL )
+	{
+		b = malloc( sizeof( Block ) + n * sizeof( MicroOp ) );
+		if( b == NULL )
+		{
+			printf( "Error: out of memory translating block at 0x%08x\n", pc );
+			exit( EXIT_ERROR );
+		}
+		b->next = BLOCK_LIST;
+		BLOCK_LIST = b;
+		++BLOCKS_TRANSLATED;
+	}
+	b->pc = pc;
+	b->num_ops = n;
+	b->exec_count = 0;
+	b->num_fused = fused;
+	b->succ[0] = NULL;
+	b->succ[1] = NULL;
+	b->jit = NULL;
+	b->jit_tried = FALSE;
+	memcpy( b->ops, ops, n * sizeof( MicroOp ) );
+	return b;
+}
+
+/************************************************************/
+/* Find or build the block starting at pc                                                          */ 
+/************************************************************/
+Block *block_lookup( uint32_t pc )
+{
+	static Block *uncached;
+	BlockPage **slot;
+	Block **entry;
+
+	++BLOCK_LOOKUPS;
+
+	//blocks outside text are rebuilt on every visit and never chained
+	if( !DECODE_IS_TEXT( pc ) || ( pc & 0x3 ) )
+	{
+		if( uncached == NULL )
+		{
+			uncached = malloc( sizeof( Block ) + BLOCK_MAX_OPS * sizeof( MicroOp ) );
+			if( uncached == NULL )
+			{
+				printf( "Error: out of memory translating block at 0x%08x\n", pc );
+				exit( EXIT_ERROR );
+			}
+		}
+		return block_translate( pc, uncached );
+	}
+
+	slot = &BLOCK_MAP[ MEM_VPN( pc ) - MEM_VPN( MEM_TEXT_BEGIN ) ];
+	if( *slot == NULL )
+	{
+		*slot = calloc( 1, sizeof( BlockPage ) );
+		if( *slot == NULL )
+		{
+			printf( "Error: out of memory allocating block map for 0x%08x\n", pc );
+			exit( EXIT_ERROR );
+		}
+	}
+
+	entry = &(*slot)->entry[ ( pc & MEM_PAGE_MASK ) >> 2 ];
+	if( *entry == NULL )
+	{
+		*entry = block_translate( pc, NULL );
+	}
+	return *entry;
+}
+
+/************************************************************/
+/* Retire block b: unmap and unchain it, free it once it can't be running   */ 
+/************************************************************/
+static void block_kill( Block *b )
+{
+	Block **link, *other;
+
+	for( link = &BLOCK_LIST; *link != NULL; )
+	{
+		other = *link;
+		if( other == b )
+		{
+			*link = other->next;
+			continue;
+		}
+		if( other->succ[0] == b )
+			other->succ[0] = NULL;
+		if( other->succ[1] == b )
+			other->succ[1] = NULL;
+		link = &other->next;
+	}
+
+	//run_blocks() may be inside b: it leaves after the current op and reaps it
+	b->next = BLOCK_DEAD;
+	BLOCK_DEAD = b;
+	BLOCK_STALE = 1;
+	++BLOCKS_INVALIDATED;
+}
+
+/************************************************************/
+/* Retire every block covering a word of [address, address + size)            */ 
+/************************************************************/
+void block_invalidate( uint32_t address, uint32_t size )
+{
+	uint32_t word, index, k;
+	BlockPage *map;
+	Block **entry;
+
+	for( word = address & ~0x3; word - ( address & ~0x3 ) < size + ( address & 0x3 ); word += 4 )
+	{
+		if( !DECODE_IS_TEXT( word ) )
+			continue;
+		map = BLOCK_MAP[ MEM_VPN( word ) - MEM_VPN( MEM_TEXT_BEGIN ) ];
+		if( map == NULL )
+			continue;
+
+		//a block stays inside its page and holds at most BLOCK_MAX_OPS words,
+		//so only the entries just below word can reach it
+		index = ( word & MEM_PAGE_MASK ) >> 2;
+		for( k = 0; k < BLOCK_MAX_OPS && k <= index; k++ )
+		{
+			entry = &map->entry[index - k];
+			if( *entry != NULL && (*entry)->num_ops > k )
+			{
+				block_kill( *entry );
+				*entry = NULL;
+			}
+		}
+	}
+}
+
+/************************************************************/
+/* Free retired blocks; only called between blocks                                        */ 
+/************************************************************/
+void block_reap()
+{
+	Block *b, *next;
+
+	for( b = BLOCK_DEAD; b != NULL; b = next )
+	{
+		next = b->next;
+		free( b );
+	}
+	BLOCK_DEAD = NULL;
+	BLOCK_STALE = 0;
+}
+
+/************************************************************/
+/* Drop every translated block                                                                           */ 
+/************************************************************/
+void block_flush()
+{
+	Block *b, *next;
+	int i;
+
+	for( b = BLOCK_LIST; b != NULL; b = next )
+	{
+		next = b->next;
+		free( b );
+	}
+	BLOCK_LIST = NULL;
+	block_reap();
+
+	for( i = 0; i < DECODE_TEXT_PAGES; i++ )
+	{
+		free( BLOCK_MAP[i] );
+		BLOCK_MAP[i] = NULL;
+	}
+	jit_reset();
+	BLOCK_STALE = 0;
+}
+
+#if defined(__x86_64__)
+/************************************************************/
+/* x86-64 code emission for jit_compile()                                                         */ 
+/************************************************************/
+static uint8_t *jit_p;
+
+static void jit_byte( uint8_t b )
+{
+	*jit_p++ = b;
+}
+
+static void jit_u32( uint32_t v )
+{
+	memcpy( jit_p, &v, 4 );
+	jit_p += 4;
+}
+
+static void jit_u64( uint64_t v )
+{
+	memcpy( jit_p, &v, 8 );
+	jit_p += 8;
+}
+
+//<op> <reg>, [rbx + 4 * guest]  where modrm selects the host register
+static void jit_guest( uint8_t op, uint8_t modrm, uint32_t guest )
+{
+	jit_byte( op );
+	jit_byte( modrm );
+	jit_u32( guest * 4 );
+}
+
+#define JIT_LOAD_EAX(g)  jit_guest( 0x8B, 0x83, (g) ) //mov eax, [rbx+d]
+#define JIT_LOAD_ECX(g)  jit_guest( 0x8B, 0x8B, (g) ) //mov ecx, [rbx+d]
+#define JIT_LOAD_ESI(g)  jit_guest( 0x8B, 0xB3, (g) ) //mov esi, [rbx+d]
+#define JIT_STORE_EAX(g) jit_guest( 0x89, 0x83, (g) ) //mov [rbx+d], eax
+#define JIT_CMP_EAX(g)   jit_guest( 0x3B, 0x83, (g) ) //cmp eax, [rbx+d]
+
+//HI and LO sit right after REGS in CPU_State
+#define JIT_HI ( ( offsetof( CPU_State, HI ) - offsetof( CPU_State, REGS ) ) / 4 )
+#define JIT_LO ( ( offsetof( CPU_State, LO ) - offsetof( CPU_State, REGS ) ) / 4 )
+
+static void jit_imm( uint8_t op, uint32_t imm )
+{
+	jit_byte( op );
+	jit_u32( imm );
+}
+
+static void jit_call( void *fn )
+{
+	jit_byte( 0x48 ); jit_byte( 0xB8 ); jit_u64( (uint64_t)(uintptr_t) fn ); //mov rax, fn
+	jit_byte( 0xFF ); jit_byte( 0xD0 );                                       //call rax
+}
+
+//return pc to the engine
+static void jit_exit( uint32_t pc )
+{
+	jit_imm( 0xB8, pc );  //mov eax, pc
+	jit_byte( 0x5B );     //pop rbx
+	jit_byte( 0xC3 );     //ret
+}
+
+//after a memory access: leave at next_pc if text was written or a watchpoint fired
+static void jit_check( uint32_t next_pc )
+{
+	jit_byte( 0x48 ); jit_byte( 0xB8 ); jit_u64( (uint64_t)(uintptr_t) &BLOCK_STALE ); //mov rax, &BLOCK_STALE
+	jit_byte( 0x8B ); jit_byte( 0x08 );                                                 //mov ecx, [rax]
+	jit_byte( 0x48 ); jit_byte( 0xB8 ); jit_u64( (uint64_t)(uintptr_t) &WATCH_HIT );   //mov rax, &WATCH_HIT
+	jit_byte( 0x0B ); jit_byte( 0x08 );                                                 //or ecx, [rax]
+	jit_byte( 0x74 ); jit_byte( 7 );                                                    //jz past the exit
+	jit_exit( next_pc );
+}
+
+//eax = guest[rs] + imm, ready as the first argument
+static void jit_address( const MicroOp *u )
+{
+	JIT_LOAD_EAX( u->rs );
+	jit_imm( 0x05, u->imm );              //add eax, imm
+	jit_byte( 0x89 ); jit_byte( 0xC7 );   //mov edi, eax
+}
+
+//cond taken: eax = target, else eax = fall-through; cmov opcode selects the condition
+static void jit_branch( uint8_t cmov, uint32_t target, uint32_t fall )
+{
+	jit_imm( 0xB8, fall );                //mov eax, fall
+	jit_imm( 0xB9, target );              //mov ecx, target
+	jit_byte( 0x0F ); jit_byte( cmov ); jit_byte( 0xC1 ); //cmovcc eax, ecx
+	jit_byte( 0x5B );
+	jit_byte( 0xC3 );
+}
+
+/************************************************************/
+/* Compile a block to host code; NULL if it holds an op the JIT leaves alone   */ 
+/************************************************************/
+JitFn jit_compile( Block *b )
+{
+	uint32_t i, pc, fall = b->pc + 4 * b->num_ops;
+	const MicroOp *u;
+	uint8_t *start, *lo, *hi;
+	uintptr_t page = sysconf( _SC_PAGESIZE );
+
+	b->jit_tried = TRUE;
+
+	for( i = 0; i < b->num_ops; i++ )
+	{
+		switch( b->ops[i].op )
+		{
+			case UOP_DIV: case UOP_DIVU: case UOP_SYSCALL:
+				return NULL;
+		}
+	}
+
+	if( JIT_CODE == NULL )
+	{
+		JIT_CODE = mmap( NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if( JIT_CODE == MAP_FAILED )
+		{
+			printf( "Warning: can't map JIT code buffer, blocks stay interpreted\n" );
+			JIT_CODE = NULL;
+			JIT_THRESHOLD = 0;
+			return NULL;
+		}
+		JIT_USED = 0;
+	}
+	//full: wait for the next block_flush()
+	if( JIT_USED + ( b->num_ops + 1 ) * JIT_OP_BYTES > JIT_CODE_SIZE )
+	{
+		return NULL;
 	}
 
-	/* Read in the program. */
+	//pages this block may touch, some holding earlier blocks: writable while emitting
+	start = jit_p = JIT_CODE + JIT_USED;
+	lo = (uint8_t *) ( (uintptr_t) start & ~( page - 1 ) );
+	hi = (uint8_t *) ( ( (uintptr_t) start + ( b->num_ops + 1 ) * JIT_OP_BYTES + page - 1 ) & ~( page - 1 ) );
+	if( mprotect( lo, hi - lo, PROT_READ | PROT_WRITE ) != 0 )
+	{
+		return NULL;
+	}
 
-	i = 0;
-	while( fscanf(fp, "%x\n", &word) != EOF ) {
-		address = MEM_TEXT_BEGIN + i;
-		mem_write_32(address, word);
-		printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
-		i += 4;
+	jit_byte( 0x53 );                                     //push rbx
+	jit_byte( 0x48 ); jit_byte( 0x89 ); jit_byte( 0xFB ); //mov rbx, rdi
+
+	for( i = 0, u = b->ops; i < b->num_ops; i++, u++ )
+	{
+		pc = b->pc + 4 * i;
+		switch( u->op )
+		{
+			case UOP_NOP:
+				break;
+
+			case UOP_ADD: case UOP_SUB: case UOP_MUL:
+			case UOP_AND: case UOP_OR: case UOP_XOR: case UOP_NOR:
+				JIT_LOAD_EAX( u->rs );
+				JIT_LOAD_ECX( u->rt );
+				switch( u->op )
+				{
+					case UOP_ADD: jit_byte( 0x01 ); jit_byte( 0xC8 ); break;                   //add eax, ecx
+					case UOP_SUB: jit_byte( 0x29 ); jit_byte( 0xC8 ); break;                   //sub eax, ecx
+					case UOP_MUL: jit_byte( 0x0F ); jit_byte( 0xAF ); jit_byte( 0xC1 ); break; //imul eax, ecx
+					case UOP_AND: jit_byte( 0x21 ); jit_byte( 0xC8 ); break;                   //and eax, ecx
+					case UOP_OR:  jit_byte( 0x09 ); jit_byte( 0xC8 ); break;                   //or eax, ecx
+					case UOP_XOR: jit_byte( 0x31 ); jit_byte( 0xC8 ); break;                   //xor eax, ecx
+					case UOP_NOR: jit_byte( 0x09 ); jit_byte( 0xC8 );
+						      jit_byte( 0xF7 ); jit_byte( 0xD0 ); break;                   //or eax, ecx; not eax
+				}
+				JIT_STORE_EAX( u->rd );
+				break;
+
+			//fused pairs compile as their first op; the second follows as usual
+			case UOP_SLT: case UOP_F_SLT_BR:
+				JIT_LOAD_EAX( u->rs );
+				JIT_CMP_EAX( u->rt );
+				jit_byte( 0x0F ); jit_byte( 0x92 ); jit_byte( 0xC0 ); //setb al
+				jit_byte( 0x0F ); jit_byte( 0xB6 ); jit_byte( 0xC0 ); //movzx eax, al
+				JIT_STORE_EAX( u->rd );
+				break;
+
+			case UOP_SLL: case UOP_SRL: case UOP_SRA:
+				JIT_LOAD_EAX( u->rt );
+				jit_byte( 0xC1 ); jit_byte( u->op == UOP_SLL ? 0xE0 : 0xE8 ); jit_byte( u->imm ); //shl/shr eax, sa
+				if( u->op == UOP_SRA )
+				{
+					jit_byte( 0x0F ); jit_byte( 0xBF ); jit_byte( 0xC0 ); //movsx eax, ax (extend_sign)
+				}
+				JIT_STORE_EAX( u->rd );
+				break;
+
+			case UOP_MTLO: JIT_LOAD_EAX( u->rs ); JIT_STORE_EAX( JIT_LO ); break;
+			case UOP_MTHI: JIT_LOAD_EAX( u->rs ); JIT_STORE_EAX( JIT_HI ); break;
+			case UOP_MFLO: JIT_LOAD_EAX( JIT_LO ); JIT_STORE_EAX( u->rd ); break;
+			case UOP_MFHI: JIT_LOAD_EAX( JIT_HI ); JIT_STORE_EAX( u->rd ); break;
+
+			case UOP_ADDI: case UOP_F_ADDI_LW: JIT_LOAD_EAX( u->rs ); jit_imm( 0x05, u->imm ); JIT_STORE_EAX( u->rt ); break;
+			case UOP_ANDI: JIT_LOAD_EAX( u->rs ); jit_imm( 0x25, u->imm ); JIT_STORE_EAX( u->rt ); break;
+			case UOP_ORI:  JIT_LOAD_EAX( u->rs ); jit_imm( 0x0D, u->imm ); JIT_STORE_EAX( u->rt ); break;
+			case UOP_XORI: JIT_LOAD_EAX( u->rs ); jit_imm( 0x35, u->imm ); JIT_STORE_EAX( u->rt ); break;
+			case UOP_LUI: case UOP_F_LUI_ORI: jit_imm( 0xB8, u->imm ); JIT_STORE_EAX( u->rt ); break;
+			case UOP_SLTI:
+				JIT_LOAD_EAX( u->rs );
+				jit_imm( 0x3D, u->imm );                              //cmp eax, imm
+				jit_byte( 0x0F ); jit_byte( 0x92 ); jit_byte( 0xC0 ); //setb al
+				jit_byte( 0x0F ); jit_byte( 0xB6 ); jit_byte( 0xC0 ); //movzx eax, al
+				JIT_STORE_EAX( u->rt );
+				break;
+
+			case UOP_LW: case UOP_LB: case UOP_LH:
+				jit_address( u );
+				if( u->op == UOP_LW )
+				{
+					jit_call( (void *) mem_read_32 );
+				}
+				else if( u->op == UOP_LB )
+				{
+					jit_call( (void *) mem_read_8 );
+					jit_byte( 0x0F ); jit_byte( 0xBE ); jit_byte( 0xC0 ); //movsx eax, al
+				}
+				else
+				{
+					jit_call( (void *) mem_read_16 );
+					jit_byte( 0x0F ); jit_byte( 0xBF ); jit_byte( 0xC0 ); //movsx eax, ax
+				}
+				JIT_STORE_EAX( u->rt );
+				jit_check( pc + 4 );
+				break;
+
+			case UOP_SW: case UOP_SB: case UOP_SH:
+				jit_address( u );
+				JIT_LOAD_ESI( u->rt );
+				jit_call( u->op == UOP_SW ? (void *) mem_write_32 : u->op == UOP_SB ? (void *) mem_write_8 : (void *) mem_write_16 );
+				jit_check( pc + 4 );
+				break;
+
+			case UOP_BEQ: case UOP_BNE:
+				JIT_LOAD_EAX( u->rs );
+				JIT_CMP_EAX( u->rt );
+				jit_branch( u->op == UOP_BEQ ? 0x44 : 0x45, u->imm, fall ); //cmove / cmovne
+				break;
+
+			case UOP_BLEZ: case UOP_BLTZ: case UOP_BGEZ:
+				JIT_LOAD_EAX( u->rs );
+				jit_byte( 0x85 ); jit_byte( 0xC0 );                         //test eax, eax
+				jit_branch( u->op == UOP_BLEZ ? 0x4E : u->op == UOP_BLTZ ? 0x48 : 0x49, u->imm, fall ); //cmovle / cmovs / cmovns
+				break;
+
+			//EX's BGTZ test holds for every value
+			case UOP_BGTZ:
+			case UOP_J: case UOP_JR: case UOP_JALR:
+				jit_exit( u->imm );
+				break;
+		}
 	}
-	PROGRAM_SIZE = i/4;
-	printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
-	fclose(fp);
+	if( !UOP_ENDS_BLOCK( b->ops[b->num_ops - 1].op ) )
+	{
+		jit_exit( fall );
+	}
+
+	if( mprotect( lo, hi - lo, PROT_READ | PROT_EXEC ) != 0 )
+	{
+		printf( "Warning: can't make JIT code executable, blocks stay interpreted\n" );
+		JIT_THRESHOLD = 0;
+		return NULL;
+	}
+
+	JIT_USED += jit_p - start;
+	++JIT_COMPILED;
+	b->jit = start;
+	return (JitFn) start;
 }
 
 /************************************************************/
-/* maintain the pipeline                                                                                           */ 
+/* Forget all compiled code (the blocks pointing at it are gone)                 */ 
 /************************************************************/
-void handle_pipeline()
+void jit_reset()
+{
+	JIT_USED = 0;
+}
+#else
+JitFn jit_compile( Block *b )
+{
+	b->jit_tried = TRUE;
+	return NULL;
+}
+
+void jit_reset()
 {
-	/*INSTRUCTION_COUNT should be incremented when instruction is done*/
-	/*Since we do not have branch/jump instructions, INSTRUCTION_COUNT should be incremented in WB stage */
-	
-	WB();
-	MEM();
-	EX();
-	ID();
-	IF();
 }
+#endif
 
 /************************************************************/
-/* writeback (WB) pipeline stage:                                                                          */ 
+/* Fill the L1Cache block holding address as a MEM-stage miss would              */ 
 /************************************************************/
-void WB()
+static void cache_warm( uint32_t address )
 {
+	CacheBlock *block = &L1Cache.blocks[ ( address & 0x000000F0 ) >> 4 ];
+	uint32_t base = address & 0xFFFFFFF0;
+	int i;
 
-	//MEM_WB.RegWrite = EX_MEM.RegWrite;
+	for( i = 0; i < WORD_PER_BLOCK; i++ )
+	{
+		block->words[i] = mem_peek( base + 4 * i, 4 );
+	}
+	block->tag = ( address & 0xFFFFFF00 );
+	block->valid = 1;
+}
 
-	uint32_t rt = ( 0x001F0000 & MEM_WB.IR  ) >> 16;
-	uint32_t rd = ( 0x0000F800 & MEM_WB.IR  ) >> 11;
+/************************************************************/
+/* Functional engine: run up to max_ins instructions (0 = until SYSCALL)        */
+/* block by block on CURRENT_STATE, bypassing the pipeline. Stops early       */
+/* when control reaches stop_pc. Returns the number of instructions executed.    */
+/************************************************************/
+uint32_t run_blocks( uint32_t max_ins, uint32_t stop_pc )
+{
+	uint32_t *R = CURRENT_STATE.REGS;
+	uint32_t pc = CURRENT_STATE.PC;
+	uint32_t count = 0, left, n, i, exit_pc, addr;
+	int taken, slot;
+	Block *b = NULL, *next;
+	MicroOp *u;
+
+	while( RUN_FLAG && !WATCH_HIT && ( max_ins == 0 || count < max_ins ) )
+	{
+		if( pc == stop_pc && count > 0 )
+		{
+			break;
+		}
+		if( BLOCK_STALE )
+		{
+			block_reap();
+			b = NULL;
+		}
+		if( b == NULL )
+		{
+			b = block_lookup( pc );
+		}
+		++b->exec_count;
+		if( b->jit == NULL && !b->jit_tried && JIT_THRESHOLD != 0 && b->exec_count >= JIT_THRESHOLD && DECODE_IS_TEXT( b->pc ) )
+		{
+			jit_compile( b );
+		}
 
-	//printf( "\n\nINS: %d", MEM_WB.type );
-	//print_instruction( MEM_WB.PC );
-	//printf( "\n\n" );
+		//a partial block only runs straight-line ops, so its exit is the next op
+		left = ( max_ins == 0 ) ? b->num_ops : max_ins - count;
+		n = ( b->num_ops < left ) ? b->num_ops : left;
+		if( stop_pc - b->pc < 4 * n && stop_pc != b->pc )
+		{
+			n = ( stop_pc - b->pc ) / 4;
+		}
 
-	if( MEM_WB.type == 0 )
+		//host code does not warm the cache
+		if( b->jit != NULL && n == b->num_ops && !FUNC_WARM_CACHE )
+		{
+			++JIT_ENTRIES;
+			pc = ( (JitFn) b->jit )( R );
+			//host code left early after a memory access
+			if( BLOCK_STALE || WATCH_HIT )
+			{
+				n = ( pc - b->pc ) / 4;
+			}
+			exit_pc = b->pc + 4 * n;
+			taken = ( pc != exit_pc );
+		}
+		else
+		{
+			exit_pc = b->pc + 4 * n;
+			taken = 1;
+
+			for( i = 0, u = b->ops; i < n; i++, u++ )
+			{
+				switch( u->op )
+				{
+					case UOP_NOP: break;
+					case UOP_ADD: R[u->rd] = R[u->rs] + R[u->rt]; break;
+					case UOP_SUB: R[u->rd] = R[u->rs] - R[u->rt]; break;
+					case UOP_MUL: R[u->rd] = R[u->rs] * R[u->rt]; break;
+					case UOP_DIV:
+						if( R[u->rt] != 0 )
+							R[u->rd] = R[u->rs] / R[u->rt];
+						break;
+					case UOP_DIVU:
+						if( R[u->rt] != 0 )
+						{
+							CURRENT_STATE.HI = R[u->rs] % R[u->rt];
+							CURRENT_STATE.LO = R[u->rs] / R[u->rt];
+						}
+						break;
+					case UOP_AND: R[u->rd] = R[u->rs] & R[u->rt]; break;
+					case UOP_OR: R[u->rd] = R[u->rs] | R[u->rt]; break;
+					case UOP_XOR: R[u->rd] = R[u->rs] ^ R[u->rt]; break;
+					case UOP_NOR: R[u->rd] = ~( R[u->rs] | R[u->rt] ); break;
+					case UOP_SLT: R[u->rd] = ( R[u->rs] < R[u->rt] ) ? 1 : 0; break;
+					case UOP_SLL: R[u->rd] = R[u->rt] << u->imm; break;
+					case UOP_SRL: R[u->rd] = R[u->rt] >> u->imm; break;
+					case UOP_SRA: R[u->rd] = extend_sign( R[u->rt] >> u->imm ); break;
+					case UOP_MTLO: CURRENT_STATE.LO = R[u->rs]; break;
+					case UOP_MTHI: CURRENT_STATE.HI = R[u->rs]; break;
+					case UOP_MFLO: R[u->rd] = CURRENT_STATE.LO; break;
+					case UOP_MFHI: R[u->rd] = CURRENT_STATE.HI; break;
+
+					case UOP_ADDI: R[u->rt] = u->imm + R[u->rs]; break;
+					case UOP_ANDI: R[u->rt] = u->imm & R[u->rs]; break;
+					case UOP_ORI: R[u->rt] = u->imm | R[u->rs]; break;
+					case UOP_XORI: R[u->rt] = u->imm ^ R[u->rs]; break;
+					case UOP_LUI: R[u->rt] = u->imm; break;
+					case UOP_SLTI: R[u->rt] = ( R[u->rs] < u->imm ) ? 1 : 0; break;
+
+					case UOP_LW: addr = u->imm + R[u->rs]; R[u->rt] = mem_read_32( addr ); goto check;
+					case UOP_LB: addr = u->imm + R[u->rs]; R[u->rt] = (int8_t) mem_read_8( addr ); goto check;
+					case UOP_LH: addr = u->imm + R[u->rs]; R[u->rt] = extend_sign( mem_read_16( addr ) ); goto check;
+					case UOP_SW: addr = u->imm + R[u->rs]; mem_write_32( addr, R[u->rt] ); goto check;
+					case UOP_SB: addr = u->imm + R[u->rs]; mem_write_8( addr, R[u->rt] ); goto check;
+					case UOP_SH: addr = u->imm + R[u->rs]; mem_write_16( addr, R[u->rt] ); goto check;
+
+					//fused pairs run their second half too unless the run stops between them
+					case UOP_F_LUI_ORI:
+						R[u->rt] = u->imm;
+						if( i + 1 < n )
+						{
+							++i; ++u;
+							R[u->rt] = u->imm | R[u->rs];
+						}
+						break;
+					case UOP_F_ADDI_LW:
+						R[u->rt] = u->imm + R[u->rs];
+						if( i + 1 < n )
+						{
+							++i; ++u;
+							addr = u->imm + R[u->rs]; R[u->rt] = mem_read_32( addr ); goto check;
+						}
+						break;
+					case UOP_F_SLT_BR:
+						R[u->rd] = ( R[u->rs] < R[u->rt] ) ? 1 : 0;
+						if( i + 1 < n )
+						{
+							++i; ++u;
+							taken = ( R[u->rs] == R[u->rt] ) == ( u->op == UOP_BEQ );
+						}
+						break;
+
+					case UOP_BEQ: taken = ( R[u->rs] == R[u->rt] ); break;
+					case UOP_BNE: taken = ( R[u->rs] != R[u->rt] ); break;
+					case UOP_BLEZ: taken = ( R[u->rs] & 0x80000000 ) || ( R[u->rs] == 0 ); break;
+					case UOP_BGTZ: taken = !( R[u->rs] & 0x80000000 ) || ( R[u->rs] != 0 ); break;
+					case UOP_BLTZ: taken = ( R[u->rs] & 0x80000000 ) != 0; break;
+					case UOP_BGEZ: taken = !( R[u->rs] & 0x80000000 ); break;
+					case UOP_J: case UOP_JR: case UOP_JALR: break;
+					case UOP_SYSCALL: RUN_FLAG = FALSE; break;
+				}
+				continue;
+
+			check:
+				if( FUNC_WARM_CACHE )
+				{
+					cache_warm( addr );
+				}
+				//a store into text or a watchpoint ends the block after this op
+				if( BLOCK_STALE || WATCH_HIT )
+				{
+					n = i + 1;
+					exit_pc = b->pc + 4 * n;
+					break;
+				}
+			}
+		}
+		count += n;
+		pc = exit_pc;
+		u = &b->ops[b->num_ops - 1];
+		if( n == b->num_ops )
+		{
+			FUSED_PAIRS += b->num_fused;
+		}
+
+		//stopped early (budget, store into text, watchpoint): resume through the dispatcher
+		if( n < b->num_ops )
+		{
+			b = NULL;
+			continue;
+		}
+		if( u->op == UOP_SYSCALL )
+		{
+			break;
+		}
+		if( u->op == UOP_JR || u->op == UOP_JALR )
+		{
+			//indirect exit
+			pc = u->imm;
+			b = NULL;
+			continue;
+		}
+
+		slot = 1;
+		if( UOP_ENDS_BLOCK( u->op ) && taken )
+		{
+			pc = u->imm;
+			slot = 0;
+		}
+
+		if( BLOCK_STALE )
+		{
+			b = NULL;
+		}
+		else if( b->succ[slot] != NULL )
+		{
+			b = b->succ[slot];
+			++BLOCK_CHAINED;
+		}
+		else
+		{
+			//first time down this exit: look the successor up and chain it
+			next = block_lookup( pc );
+			if( DECODE_IS_TEXT( b->pc ) && DECODE_IS_TEXT( pc ) && !( pc & 0x3 ) )
+			{
+				b->succ[slot] = next;
+			}
+			b = next;
+		}
+	}
+
+	CURRENT_STATE.PC = pc;
+	NEXT_STATE = CURRENT_STATE;
+	INSTRUCTION_COUNT += count;
+	return count;
+}
+
+/************************************************************/
+/* Drain the pipeline, run functionally and report what the block cache did  */ 
+/************************************************************/
+void frun( uint32_t max_ins, uint32_t stop_pc )
+{
+	uint64_t lookups = BLOCK_LOOKUPS, chained = BLOCK_CHAINED, built = BLOCKS_TRANSLATED, retired = BLOCKS_INVALIDATED;
+	uint64_t compiled = JIT_COMPILED, native = JIT_ENTRIES, fused = FUSED_PAIRS;
+	uint32_t done;
+	clock_t start;
+	double secs;
+
+	if( RUN_FLAG == FALSE )
 	{
-		NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-		CURRENT_STATE.REGS[rd] = MEM_WB.ALUOutput;
+		if( !QUIET ) printf( "Simulation Stopped.\n\n" );
+		return;
+	}
 
-		NEXT_STATE.HI = MEM_WB.HI;
-		NEXT_STATE.LO = MEM_WB.LO;
-		CURRENT_STATE.HI = MEM_WB.HI;
-		CURRENT_STATE.LO = MEM_WB.LO;
+	pipeline_drain();
+	WATCH_HIT = 0;
+	start = clock();
+	done = run_blocks( max_ins, stop_pc );
+	FF_INSTRUCTIONS += done;
+	secs = (double)( clock() - start ) / CLOCKS_PER_SEC;
 
+	//lines filled before the run may no longer match memory
+	if( !FUNC_WARM_CACHE )
+	{
+		memset( &L1Cache, 0, sizeof( L1Cache ) );
 	}
-	else if( MEM_WB.type == 1)
+
+	if( QUIET )
 	{
-		NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-		CURRENT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+		return;
 	}
-	else if( MEM_WB.type == 2 )
+	printf( "Functional run: %u instructions", done );
+	if( secs > 0 )
+	{
+		printf( " (%.1f MIPS)", done / secs / 1e6 );
+	}
+	printf( "\nBlocks: %llu translated, %llu invalidated, %llu dispatcher lookups, %llu chained entries\n",
+		(unsigned long long)( BLOCKS_TRANSLATED - built ),
+		(unsigned long long)( BLOCKS_INVALIDATED - retired ),
+		(unsigned long long)( BLOCK_LOOKUPS - lookups ),
+		(unsigned long long)( BLOCK_CHAINED - chained ) );
+	printf( "JIT: %llu blocks compiled, %llu block entries ran host code\n",
+		(unsigned long long)( JIT_COMPILED - compiled ),
+		(unsigned long long)( JIT_ENTRIES - native ) );
+	printf( "Fusion: %llu pairs fused", (unsigned long long)( FUSED_PAIRS - fused ) );
+	if( done > 0 )
+	{
+		printf( " (%.1f%% of instructions)", 200.0 * ( FUSED_PAIRS - fused ) / done );
+	}
+	printf( "\n" );
+	printf( "PC\t: 0x%08x\n\n", CURRENT_STATE.PC );
+}
+
+/************************************************************/
+/* Skip to the region of interest functionally, then hand over to the          */
+/* pipeline with its counters cleared so later stats cover only that region.     */
+/************************************************************/
+void fast_forward( uint32_t max_ins, uint32_t stop_pc )
+{
+	frun( max_ins, stop_pc );
+
+	INSTRUCTION_COUNT = 0;
+	CYCLE_COUNT = 0;
+	cache_hits = 0;
+	cache_misses = 0;
+	stats_reset();
+	if( !QUIET ) printf( "Detailed simulation resumes at 0x%08x (%u instructions fast-forwarded in total, cache %s)\n\n",
+		CURRENT_STATE.PC, FF_INSTRUCTIONS, FUNC_WARM_CACHE ? "warm" : "cold" );
+}
+
+/************************************************************/
+/* Page of a lane's memory holding address: its private copy if it has one,   */
+/* else the shared guest page. A write first makes the private copy; NULL      */
+/* when the lane has no private pages left.                                    */
+/************************************************************/
+static uint32_t *batch_page( BatchLane *lane, uint32_t address, int write )
+{
+	uint32_t vpn = MEM_VPN( address ), i;
+	BatchPage *p;
+
+	for( i = 0; i < lane->num_pages; i++ )
+	{
+		if( lane->pages[i].vpn == vpn )
+			return lane->pages[i].page;
+	}
+	if( !write )
+		return mem_page_read( address );
+	if( lane->num_pages == BATCH_LANE_PAGES )
+		return NULL;
+
+	p = &lane->pages[lane->num_pages];
+	p->page = malloc( MEM_PAGE_SIZE );
+	if( p->page == NULL )
+	{
+		printf( "Error: out of memory allocating a batch page for 0x%08x\n", address );
+		exit( EXIT_ERROR );
+	}
+	memcpy( p->page, mem_page_read( address ), MEM_PAGE_SIZE );
+	p->vpn = vpn;
+	lane->num_pages++;
+	return p->page;
+}
+
+static uint32_t batch_load( BatchLane *lane, uint32_t address, int size )
+{
+	uint32_t value = 0;
+	int i;
+
+	if( ( address & ( size - 1 ) ) == 0 )
+		return mem_host_load( batch_page( lane, address, FALSE ), address & MEM_PAGE_MASK, size );
+
+	for( i = size - 1; i >= 0; i-- )
+		value = ( value << 8 ) | MEM_BYTE( batch_page( lane, address + i, FALSE ), ( address + i ) & MEM_PAGE_MASK );
+	return value;
+}
+
+//FALSE if the lane ran out of private pages
+static int batch_store( BatchLane *lane, uint32_t address, int size, uint32_t value )
+{
+	uint32_t *page;
+	int i;
+
+	if( ( address & ( size - 1 ) ) == 0 )
+	{
+		page = batch_page( lane, address, TRUE );
+		if( page == NULL )
+			return FALSE;
+		mem_host_store( page, address & MEM_PAGE_MASK, size, value );
+		return TRUE;
+	}
+
+	for( i = 0; i < size; i++ )
+	{
+		page = batch_page( lane, address + i, TRUE );
+		if( page == NULL )
+			return FALSE;
+		MEM_BYTE( page, ( address + i ) & MEM_PAGE_MASK ) = ( value >> ( 8 * i ) ) & 0xFF;
+	}
+	return TRUE;
+}
+
+/************************************************************/
+/* Execute d for lane l alone, as run_blocks() would. A branch only records    */
+/* its outcome in BATCH.taken. FALSE if the lane had to be stopped.            */
+/************************************************************/
+static int batch_scalar( const DecodedIns *d, uint32_t l )
+{
+	uint32_t rs = BATCH.REGS[d->rs][l], rt = BATCH.REGS[d->rt][l];
+	uint32_t *rd_reg = &BATCH.REGS[d->rd][l], *rt_reg = &BATCH.REGS[d->rt][l];
+	uint32_t addr = d->imm + rs;
+	BatchLane *lane = &BATCH.lane[l];
+	int ok = TRUE;
+
+	switch( d->uop )
+	{
+		case UOP_ADD: *rd_reg = rs + rt; break;
+		case UOP_SUB: *rd_reg = rs - rt; break;
+		case UOP_MUL: *rd_reg = rs * rt; break;
+		case UOP_DIV:
+			if( rt != 0 )
+				*rd_reg = rs / rt;
+			break;
+		case UOP_DIVU:
+			if( rt != 0 )
+			{
+				BATCH.HI[l] = rs % rt;
+				BATCH.LO[l] = rs / rt;
+			}
+			break;
+		case UOP_AND: *rd_reg = rs & rt; break;
+		case UOP_OR: *rd_reg = rs | rt; break;
+		case UOP_XOR: *rd_reg = rs ^ rt; break;
+		case UOP_NOR: *rd_reg = ~( rs | rt ); break;
+		case UOP_SLT: *rd_reg = ( rs < rt ) ? 1 : 0; break;
+		case UOP_SLL: *rd_reg = rt << d->sa; break;
+		case UOP_SRL: *rd_reg = rt >> d->sa; break;
+		case UOP_SRA: *rd_reg = extend_sign( rt >> d->sa ); break;
+		case UOP_MTLO: BATCH.LO[l] = rs; break;
+		case UOP_MTHI: BATCH.HI[l] = rs; break;
+		case UOP_MFLO: *rd_reg = BATCH.LO[l]; break;
+		case UOP_MFHI: *rd_reg = BATCH.HI[l]; break;
+
+		case UOP_ADDI: *rt_reg = d->imm + rs; break;
+		case UOP_ANDI: *rt_reg = ( d->imm & 0x0000FFFF ) & rs; break;
+		case UOP_ORI: *rt_reg = ( d->imm & 0x0000FFFF ) | rs; break;
+		case UOP_XORI: *rt_reg = ( d->imm & 0x0000FFFF ) ^ rs; break;
+		case UOP_LUI: *rt_reg = d->imm << 16; break;
+		case UOP_SLTI: *rt_reg = ( rs < d->imm ) ? 1 : 0; break;
+
+		case UOP_LW: *rt_reg = batch_load( lane, addr, 4 ); break;
+		case UOP_LB: *rt_reg = (int8_t) batch_load( lane, addr, 1 ); break;
+		case UOP_LH: *rt_reg = extend_sign( batch_load( lane, addr, 2 ) ); break;
+		case UOP_SW: ok = batch_store( lane, addr, 4, rt ); break;
+		case UOP_SB: ok = batch_store( lane, addr, 1, rt ); break;
+		case UOP_SH: ok = batch_store( lane, addr, 2, rt ); break;
+
+		case UOP_BEQ: BATCH.taken[l] = ( rs == rt ); break;
+		case UOP_BNE: BATCH.taken[l] = ( rs != rt ); break;
+		case UOP_BLEZ: BATCH.taken[l] = ( rs & 0x80000000 ) || ( rs == 0 ); break;
+		case UOP_BGTZ: BATCH.taken[l] = !( rs & 0x80000000 ) || ( rs != 0 ); break;
+		case UOP_BLTZ: BATCH.taken[l] = ( rs & 0x80000000 ) != 0; break;
+		case UOP_BGEZ: BATCH.taken[l] = !( rs & 0x80000000 ); break;
+	}
+
+	if( !ok )
+	{
+		printf( "Error: batch lane %u wrote more than %d pages, lane stopped\n", l, BATCH_LANE_PAGES );
+		lane->state = BATCH_DONE;
+		BATCH.mask[l] = 0;
+	}
+	return ok;
+}
+
+/************************************************************/
+/* Execute d for every lane in the group with host vector ops. Lanes outside  */
+/* the group keep their registers. FALSE for instructions left to              */
+/* batch_scalar(): memory accesses, DIV/DIVU, jumps and BGTZ.                  */
+/************************************************************/
+#if defined(__x86_64__)
+__attribute__((target_clones("avx2", "default")))
+#endif
+static int batch_vector( const DecodedIns *d )
+{
+	BatchVec *m = (BatchVec *) BATCH.mask;
+	BatchVec *s = (BatchVec *) BATCH.REGS[d->rs];
+	BatchVec *t = (BatchVec *) BATCH.REGS[d->rt];
+	BatchVec *rd = (BatchVec *) BATCH.REGS[d->rd];
+	BatchVec *hi = (BatchVec *) BATCH.HI;
+	BatchVec *lo = (BatchVec *) BATCH.LO;
+	BatchVec *taken = (BatchVec *) BATCH.taken;
+	BatchVec zero = { 0 };
+	BatchVec one = zero + 1, sign = zero + 0x80000000, upper = zero + 0xFFFF0000;
+	BatchVec imm = zero + d->imm, immz = zero + ( d->imm & 0x0000FFFF ), v;
+	uint32_t c, n = BATCH.num_lanes / BATCH_VEC, sa = d->sa;
+
+//dst = expr in the group's lanes; the other lanes keep dst
+#define BATCH_EACH( dst, expr ) \
+	for( c = 0; c < n; c++ ) { v = ( expr ); dst[c] = ( v & m[c] ) | ( dst[c] & ~m[c] ); }
+#define BATCH_TEST( expr ) \
+	for( c = 0; c < n; c++ ) { taken[c] = (BatchVec)( expr ); }
+
+	switch( d->uop )
+	{
+		case UOP_ADD: BATCH_EACH( rd, s[c] + t[c] ); break;
+		case UOP_SUB: BATCH_EACH( rd, s[c] - t[c] ); break;
+		case UOP_MUL: BATCH_EACH( rd, s[c] * t[c] ); break;
+		case UOP_AND: BATCH_EACH( rd, s[c] & t[c] ); break;
+		case UOP_OR: BATCH_EACH( rd, s[c] | t[c] ); break;
+		case UOP_XOR: BATCH_EACH( rd, s[c] ^ t[c] ); break;
+		case UOP_NOR: BATCH_EACH( rd, ~( s[c] | t[c] ) ); break;
+		case UOP_SLT: BATCH_EACH( rd, (BatchVec)( s[c] < t[c] ) & one ); break;
+		case UOP_SLL: BATCH_EACH( rd, t[c] << sa ); break;
+		case UOP_SRL: BATCH_EACH( rd, t[c] >> sa ); break;
+		//extend_sign() of the shifted value
+		case UOP_SRA: BATCH_EACH( rd, ( t[c] >> sa ) | ( upper & -( ( t[c] >> sa >> 15 ) & one ) ) ); break;
+		case UOP_MTLO: BATCH_EACH( lo, s[c] ); break;
+		case UOP_MTHI: BATCH_EACH( hi, s[c] ); break;
+		case UOP_MFLO: BATCH_EACH( rd, lo[c] ); break;
+		case UOP_MFHI: BATCH_EACH( rd, hi[c] ); break;
+
+		case UOP_ADDI: BATCH_EACH( t, s[c] + imm ); break;
+		case UOP_ANDI: BATCH_EACH( t, s[c] & immz ); break;
+		case UOP_ORI: BATCH_EACH( t, s[c] | immz ); break;
+		case UOP_XORI: BATCH_EACH( t, s[c] ^ immz ); break;
+		case UOP_LUI: BATCH_EACH( t, imm << 16 ); break;
+		case UOP_SLTI: BATCH_EACH( t, (BatchVec)( s[c] < imm ) & one ); break;
+
+		case UOP_BEQ: BATCH_TEST( s[c] == t[c] ); break;
+		case UOP_BNE: BATCH_TEST( s[c] != t[c] ); break;
+		case UOP_BLEZ: BATCH_TEST( ( ( s[c] & sign ) != zero ) | ( s[c] == zero ) ); break;
+		case UOP_BLTZ: BATCH_TEST( ( s[c] & sign ) != zero ); break;
+		case UOP_BGEZ: BATCH_TEST( ( s[c] & sign ) == zero ); break;
+
+		default:
+			return FALSE;
+	}
+#undef BATCH_EACH
+#undef BATCH_TEST
+	return TRUE;
+}
+
+/************************************************************/
+/* Take lane l out of the group; it waits at pc                                             */ 
+/************************************************************/
+static void batch_park( uint32_t l, uint32_t pc )
+{
+	BATCH.lane[l].state = BATCH_PARKED;
+	BATCH.lane[l].pc = pc;
+	BATCH.mask[l] = 0;
+	BATCH.num_parked++;
+	++BATCH_DIVERGED;
+}
+
+/************************************************************/
+/* Bring every lane parked at pc into the group                                           */ 
+/************************************************************/
+static void batch_join( uint32_t pc )
+{
+	uint32_t l;
+
+	for( l = 0; l < BATCH.num_lanes && BATCH.num_parked > 0; l++ )
+	{
+		if( BATCH.lane[l].state == BATCH_PARKED && BATCH.lane[l].pc == pc )
+		{
+			BATCH.lane[l].state = BATCH_GROUP;
+			BATCH.mask[l] = 0xFFFFFFFF;
+			BATCH.group[BATCH.group_size++] = l;
+			BATCH.num_parked--;
+		}
+	}
+}
+
+/************************************************************/
+/* Execute the instruction at the group's pc for all its lanes                          */ 
+/************************************************************/
+static void batch_step()
+{
+	const DecodedIns *d = decode_fetch( BATCH.group_pc );
+	uint32_t pc = BATCH.group_pc, next = pc + 4, target, k, l, n_taken = 0, kept = 0;
+	int follow, stopped = FALSE;
+
+	if( BATCH.group_size > 1 && batch_vector( d ) )
+	{
+		++BATCH_VECTOR_STEPS;
+	}
+	else
 	{
-		NEXT_STATE.REGS[rt] = MEM_WB.LMD;
-		CURRENT_STATE.REGS[rt] = MEM_WB.LMD;
-		//printf( "\nLoaded %x\n", MEM_WB.LMD );
+		for( k = 0; k < BATCH.group_size; k++ )
+		{
+			if( !batch_scalar( d, BATCH.group[k] ) )
+				stopped = TRUE;
+		}
+		BATCH_SCALAR_STEPS += BATCH.group_size;
 	}
-	else if( MEM_WB.type == 3 )
+	BATCH_INSTRUCTIONS += BATCH.group_size;
+
+	switch( d->uop )
 	{
-			printf( "\nWB UPDATE[%x]:\n"
-				"-> [0] = %u\n"
-				"-> [4] = %u\n"
-				"-> [8] = %u\n"
-				"-> [c] = %u\n", ( (MEM_WB.ALUOutput) ),
-				writeBuffer.words[0],writeBuffer.words[1],writeBuffer.words[2],writeBuffer.words[3]);
+		case UOP_BEQ: case UOP_BNE: case UOP_BLEZ:
+		case UOP_BGTZ: case UOP_BLTZ: case UOP_BGEZ:
+			target = pc + extend_sign( d->imm << 2 );
+			for( k = 0; k < BATCH.group_size; k++ )
+				n_taken += ( BATCH.taken[BATCH.group[k]] != 0 );
+
+			//the larger side stays in lockstep, the rest wait on the other path
+			follow = ( 2 * n_taken >= BATCH.group_size );
+			next = follow ? target : pc + 4;
+			for( k = 0; k < BATCH.group_size; k++ )
+			{
+				l = BATCH.group[k];
+				if( ( BATCH.taken[l] != 0 ) == follow )
+					BATCH.group[kept++] = l;
+				else
+					batch_park( l, follow ? pc + 4 : target );
+			}
+			BATCH.group_size = kept;
+			break;
 
-		mem_write_32( (MEM_WB.ALUOutput & 0xFFFFFFF0) + 0x0, writeBuffer.words[0] );
-		mem_write_32( (MEM_WB.ALUOutput & 0xFFFFFFF0) + 0x4, writeBuffer.words[1] );
-		mem_write_32( (MEM_WB.ALUOutput & 0xFFFFFFF0) + 0x8, writeBuffer.words[2] );
-		mem_write_32( (MEM_WB.ALUOutput & 0xFFFFFFF0) + 0xC, writeBuffer.words[3] );
+		//EX's jump targets
+		case UOP_J: next = ( pc & 0xF0000000 ) | d->target; break;
+		case UOP_JR: next = 0x004000bc; break;
+		case UOP_JALR: next = 0x00400090; break;
+
+		case UOP_SYSCALL:
+			for( k = 0; k < BATCH.group_size; k++ )
+			{
+				BATCH.lane[BATCH.group[k]].state = BATCH_DONE;
+				BATCH.lane[BATCH.group[k]].pc = next;
+				BATCH.mask[BATCH.group[k]] = 0;
+			}
+			BATCH.group_size = 0;
+			break;
 	}
-	else if( MEM_WB.type == 4)
+
+	//drop lanes batch_scalar() had to stop
+	if( stopped )
 	{
-		//NEXT_STATE.REGS[0] = 0XA;
-		RUN_FLAG = FALSE;
+		for( k = 0, kept = 0; k < BATCH.group_size; k++ )
+		{
+			if( BATCH.lane[BATCH.group[k]].state == BATCH_GROUP )
+				BATCH.group[kept++] = BATCH.group[k];
+		}
+		BATCH.group_size = kept;
 	}
-	else if( MEM_WB.type == 5)
+
+	BATCH.group_pc = next;
+	if( BATCH.num_parked > 0 && BATCH.group_size > 0 && UOP_ENDS_BLOCK( d->uop ) )
 	{
+		batch_join( next );
 	}
-
-  	++INSTRUCTION_COUNT;
 }
 
 /************************************************************/
-/* memory access (MEM) pipeline stage:                                                          */ 
+/* Run the program as `lanes` lockstep instances. Lane i gets the i-th equal  */
+/* slice of the hex words in in_path stored at in_addr ("-" for none). With an  */
+/* out_path, one line per lane lists its final pc, registers and input slice.   */
+/* Lanes still running after max_ins instructions in all (0 = no limit) stop.  */
 /************************************************************/
-void MEM()
+void batch_run( uint32_t lanes, const char *in_path, uint32_t in_addr, const char *out_path, uint32_t max_ins )
 {
-	if( MEM_STALL > 0 )
+	uint32_t *input = NULL, num_input = 0, max_input = 0, per_lane = 0, word, l, i, r, pc, stopped = 0;
+	clock_t start;
+	double secs;
+	FILE *fp;
+
+	if( RUN_FLAG == FALSE )
 	{
-		--MEM_STALL;
-		printf( "MEM STAGE STALL : %d", MEM_STALL ); 
+		if( !QUIET ) printf( "Simulation Stopped.\n\n" );
+		return;
+	}
+	if( lanes == 0 || lanes > BATCH_MAX_LANES )
+	{
+		printf( "Error: batch needs 1 to %d lanes\n", BATCH_MAX_LANES );
 		return;
 	}
 
-	MEM_WB.IR = EX_MEM.IR;
-	MEM_WB.PC = EX_MEM.PC;
-	MEM_WB.type = EX_MEM.type;
-	MEM_WB.RegisterRs = EX_MEM.RegisterRs;
-	MEM_WB.RegisterRt = EX_MEM.RegisterRt;
-	MEM_WB.RegisterRd = EX_MEM.RegisterRd;
-	MEM_WB.RegWrite = EX_MEM.RegWrite;
-	MEM_WB.DestReg = EX_MEM.DestReg;
-
-	MEM_WB.LO = EX_MEM.LO;
-	MEM_WB.HI = EX_MEM.HI;
+	if( strcmp( in_path, "-" ) != 0 )
+	{
+		fp = fopen( in_path, "r" );
+		if( fp == NULL )
+		{
+			printf( "Error: Can't open batch input file %s\n", in_path );
+			return;
+		}
+		while( fscanf( fp, "%x", &word ) == 1 )
+		{
+			if( num_input == max_input )
+			{
+				max_input = max_input ? 2 * max_input : 1024;
+				input = realloc( input, max_input * sizeof( uint32_t ) );
+				if( input == NULL )
+				{
+					printf( "Error: out of memory reading %s\n", in_path );
+					exit( EXIT_ERROR );
+				}
+			}
+			input[num_input++] = word;
+		}
+		fclose( fp );
+		per_lane = num_input / lanes;
+		if( num_input % lanes != 0 )
+		{
+			printf( "Warning: %u input words do not split across %u lanes; the last %u are not loaded\n",
+				num_input, lanes, num_input % lanes );
+		}
+	}
 
-	printf( "\nHITS: %d; MISSES: %d\n", cache_hits, cache_misses );
+	pipeline_drain();
 
-	if(EX_MEM.type <= 1)		//0 reg-reg, 1 reg-imm
+	//lanes past the last one pad the vectors and stay BATCH_DONE
+	memset( &BATCH, 0, sizeof( BATCH ) );
+	BATCH.num_lanes = ( lanes + BATCH_VEC - 1 ) / BATCH_VEC * BATCH_VEC;
+	for( l = 0; l < lanes; l++ )
 	{
-		MEM_WB.ALUOutput = EX_MEM.ALUOutput;
+		for( r = 0; r < MIPS_REGS; r++ )
+			BATCH.REGS[r][l] = CURRENT_STATE.REGS[r];
+		BATCH.HI[l] = CURRENT_STATE.HI;
+		BATCH.LO[l] = CURRENT_STATE.LO;
+		BATCH.lane[l].state = BATCH_GROUP;
+		BATCH.mask[l] = 0xFFFFFFFF;
+		BATCH.group[l] = l;
+		for( i = 0; i < per_lane; i++ )
+		{
+			if( !batch_store( &BATCH.lane[l], in_addr + 4 * i, 4, input[l * per_lane + i] ) )
+			{
+				printf( "Error: batch input slice does not fit in %d pages\n", BATCH_LANE_PAGES );
+				break;
+			}
+		}
 	}
-	else if(EX_MEM.type == 2)	//2 is Load
-	{
-		uint32_t index = ( EX_MEM.ALUOutput & 0x000000F0 ) >> 4;
-		uint32_t word_offset  = ( EX_MEM.ALUOutput & 0x0000000C ) >> 2;
-		//uint32_t byteoff  = ( MEM_WB.ALUOutput & 0x00000003 );
-		CacheBlock getBlock = L1Cache.blocks[index];
+	free( input );
+	BATCH.group_size = lanes;
+	BATCH.group_pc = CURRENT_STATE.PC;
+	BATCH_INSTRUCTIONS = BATCH_VECTOR_STEPS = BATCH_SCALAR_STEPS = BATCH_DIVERGED = 0;
 
-		if( EX_MEM.CacheMiss == 0 )
+	start = clock();
+	while( TRUE )
+	{
+		//group finished: the parked lanes furthest behind go next
+		if( BATCH.group_size == 0 )
 		{
-			//HIT
-			MEM_WB.LMD = getBlock.words[word_offset];
+			if( BATCH.num_parked == 0 )
+				break;
+			pc = 0xFFFFFFFF;
+			for( l = 0; l < BATCH.num_lanes; l++ )
+			{
+				if( BATCH.lane[l].state == BATCH_PARKED && BATCH.lane[l].pc < pc )
+					pc = BATCH.lane[l].pc;
+			}
+			BATCH.group_pc = pc;
+			batch_join( pc );
 		}
-		else
+		if( max_ins != 0 && BATCH_INSTRUCTIONS >= max_ins )
 		{
-			//MISS
-			MEM_WB.LMD = mem_read_32( EX_MEM.ALUOutput );
-			getBlock.words[0] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x0 );
-			getBlock.words[1] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x4 );
-			getBlock.words[2] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x8 );
-			getBlock.words[3] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0xC );
-
-			MEM_STALL = 100;
+			break;
 		}
+		batch_step();
 	}
-	else if(EX_MEM.type == 3)	//3 is store
+
+	//out of budget: whatever is still running stops where it is
+	for( l = 0; l < lanes; l++ )
 	{
-		int index = ( EX_MEM.ALUOutput & 0x000000F0 ) >> 4;
-		int word_offset  = ( EX_MEM.ALUOutput & 0x0000000C ) >> 2;
-		CacheBlock * getBlock = &L1Cache.blocks[index];
+		if( BATCH.lane[l].state == BATCH_GROUP )
+			BATCH.lane[l].pc = BATCH.group_pc;
+		if( BATCH.lane[l].state != BATCH_DONE )
+			++stopped;
+	}
+	secs = (double)( clock() - start ) / CLOCKS_PER_SEC;
 
-		if( EX_MEM.CacheMiss == 0 )
+	if( !QUIET )
+	{
+		printf( "Batch: %u lanes, %llu instructions", lanes, (unsigned long long) BATCH_INSTRUCTIONS );
+		if( secs > 0 )
 		{
-			//HIT
-			getBlock->words[word_offset] = EX_MEM.B;
-			writeBuffer = *getBlock;
-			MEM_WB.ALUOutput = EX_MEM.ALUOutput;
+			printf( " (%.1f MIPS)", BATCH_INSTRUCTIONS / secs / 1e6 );
 		}
-		else
+		printf( "\nLockstep: %llu vector steps, %llu scalar lane steps, %llu lanes diverged\n",
+			(unsigned long long) BATCH_VECTOR_STEPS,
+			(unsigned long long) BATCH_SCALAR_STEPS,
+			(unsigned long long) BATCH_DIVERGED );
+		if( stopped > 0 )
 		{
-			//MISS
-			getBlock->words[0] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x0 );
-			getBlock->words[1] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x4 );
-			getBlock->words[2] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0x8 );
-			getBlock->words[3] = mem_read_32( (EX_MEM.ALUOutput & 0xFFFFFFF0) + 0xC );
-			
-			getBlock->words[word_offset] = EX_MEM.B;
-
-			getBlock->tag = ( EX_MEM.ALUOutput & 0xFFFFFF00 );
-			getBlock->valid = 1;
+			printf( "Stopped: %u lanes had not reached SYSCALL after %u instructions\n", stopped, max_ins );
+		}
+	}
 
-			writeBuffer = *getBlock;
-			MEM_WB.ALUOutput = EX_MEM.ALUOutput;
+	fp = NULL;
+	if( strcmp( out_path, "-" ) != 0 )
+	{
+		fp = fopen( out_path, "w" );
+		if( fp == NULL )
+		{
+			printf( "Error: Can't open batch output file %s\n", out_path );
 		}
-		
 	}
-	else if(EX_MEM.type == 6)
+	for( l = 0; l < lanes; l++ )
 	{
-		MEM_WB.ALUOutput = EX_MEM.ALUOutput;
+		if( fp != NULL )
+		{
+			fprintf( fp, "lane %u %s pc 0x%08x regs", l, BATCH.lane[l].state == BATCH_DONE ? "finished" : "stopped", BATCH.lane[l].pc );
+			for( r = 0; r < MIPS_REGS; r++ )
+				fprintf( fp, " %08x", BATCH.REGS[r][l] );
+			fprintf( fp, " hi %08x lo %08x data", BATCH.HI[l], BATCH.LO[l] );
+			for( i = 0; i < per_lane; i++ )
+				fprintf( fp, " %08x", batch_load( &BATCH.lane[l], in_addr + 4 * i, 4 ) );
+			fprintf( fp, "\n" );
+		}
+		for( i = 0; i < BATCH.lane[l].num_pages; i++ )
+			free( BATCH.lane[l].pages[i].page );
 	}
-
+	if( fp != NULL )
+	{
+		fclose( fp );
+		if( !QUIET ) printf( "Lane results written to %s\n", out_path );
+	}
+	if( !QUIET ) printf( "\n" );
 }
 
 /************************************************************/
@@ -514,674 +4210,43 @@ void MEM()
 /************************************************************/
 void EX()
 {
+	TRACE_STAGE( ID_EX );
 	if( MEM_STALL > 0 )
 	{
+		EVENT( EV_EX, EV_STALL, EV_REASON_CACHE, 0, ID_EX.PC, ID_EX.IR, 0 );
 		return;
 	}
 
 	//Load INstruction from Buffer
 	EX_MEM.IR = ID_EX.IR;
 	EX_MEM.PC = ID_EX.PC;
+	EX_MEM.D = ID_EX.D;
+	EX_MEM.Filtered = ID_EX.Filtered;
 	EX_MEM.RegisterRs = ID_EX.RegisterRs;
 	EX_MEM.RegisterRt = ID_EX.RegisterRt;
 	EX_MEM.RegisterRd = ID_EX.RegisterRd;
 	EX_MEM.CacheMiss = 0;
 
-	//opcode MASK: 1111 1100 0000 0000 4x0000 = FC0000000
-	uint32_t oc = ( 0xFC000000 & EX_MEM.IR  );
-  	//uint32_t imm = ID_EX.imm;
-	uint32_t func = (EX_MEM.IR & 0x0000003F);
-	//rs MASK: 0000 0011 1110 0000 4x0000 = 03E00000
-	uint32_t rs = ( 0x03E00000 & EX_MEM.IR  ) >> 21;
-	//rt MASK: 0000 0000 0001 1111 4x0000 = 001F0000;
-	uint32_t rt = ( 0x001F0000 & EX_MEM.IR  ) >> 16;
-	//rd MASK: 4x0000 1111 1000 0000 0000 = 0000F800;
-	//uint32_t rd = ( 0x0000F800 & EX_MEM.IR  ) >> 11;
-	//sa MASK: 4X0000 0000 0111 1100 0000 = 000007C0;
-	uint32_t sa = ( 0x000007C0 & EX_MEM.IR  ) >> 6;
-
 	if( ID_EX.IR == 0 )
 	{
 		EX_MEM.type = 5;
 		EX_MEM.RegWrite = 0;
 		EX_MEM.DestReg = 0;
-		puts( "EX STALLED ONE CYCLE" );
+		TRACE( TRACE_HAZARD, TRACE_INFO, "EX STALLED ONE CYCLE\n" );
+		EVENT( EV_EX, EV_BUBBLE, EV_REASON_NONE, 0, ID_EX.PC, 0, 0 );
 		return;
 	}
 
-	//Handle each case for instructions
-	switch( oc )
-	{
-		//R-Type
-		case 0x00000000: 
-			{  
-				EX_MEM.type = 0;
-				EX_MEM.RegWrite = 1;
-				EX_MEM.DestReg = EX_MEM.RegisterRd;
-
-				switch( func ) 
-				{
-					case 0x00000020: 
-						//ADD
-						puts( "Add Function" );
-						EX_MEM.ALUOutput = ID_EX.A + ID_EX.B;
-						break; 
-
-					case 0x00000021:
-						//ADDU
-
-						puts( "Add Unsigned Function" );
-						EX_MEM.ALUOutput = ID_EX.A + ID_EX.B;
-						break; 
-
-					case 0x00000022:
-						//SUB
-						puts( "Subtract Function" );
-						EX_MEM.ALUOutput = ID_EX.A - ID_EX.B;
-						break;
-
-					case 0x00000023:
-						//SUBU
-						puts( "Subtract Unsigned Function" );
-						EX_MEM.ALUOutput = ID_EX.A - ID_EX.B;
-						break;
-
-					case 0x00000018:
-					{
-						//MULT
-						puts( "Multiply Function" );
-						EX_MEM.ALUOutput = ID_EX.A * ID_EX.B;
-						break;
-					}
-
-					case 0x00000019:
-					{
-						//MULTU
-						puts( "Multiply Unsigned Function" );
-						EX_MEM.ALUOutput = ID_EX.A * ID_EX.B;
-						break;
-					}
-
-					case 0x0000001A:
-						//DIV
-						puts( "Divide Function" );
-						EX_MEM.ALUOutput = ID_EX.A / ID_EX.B;
-						CNT_STALL += 2;
-						break;
-
-					case 0x0000001B:
-						//DIVU
-						puts( "Divide Unsigned Function" );
-						EX_MEM.type = 5;
-						if( ID_EX.B == 0 )
-						{ 
-							puts( "ERROR: Trying to divide by 0" ); 
-						}
-						else
-						{
-							EX_MEM.ALUOutput = 0;
-							EX_MEM.HI = ID_EX.A % ID_EX.B ;
-							EX_MEM.LO = ID_EX.A / ID_EX.B ;
-						}
-						CNT_STALL += 2;
-						break;
-
-					case 0X00000024:
-						//AND                              
-						puts("AND" );
-						EX_MEM.ALUOutput = ID_EX.A & ID_EX.B;
-						break; 
-
-					case 0X00000025:
-						//OR                      
-						puts("OR" );
-						EX_MEM.ALUOutput = ID_EX.A | ID_EX.B;
-						break; 
-					
-					case 0X00000026:
-						//XOR                      
-						puts("XOR" );
-						EX_MEM.ALUOutput = ID_EX.A ^ ID_EX.B;
-						break;
-
-					case 0x00000027:
-						//NOR                      
-						puts("NOR" );
-						EX_MEM.ALUOutput = ~( ID_EX.A | ID_EX.B );
-						break;
-
-					case 0x0000002A:
-						//SLT                      
-						puts("SLT" );
-						if( ID_EX.A < ID_EX.B )
-							EX_MEM.ALUOutput = 0x00000001;
-						else
-							EX_MEM.ALUOutput = 0x00000000;
-						break;
-
-					case 0x00000000:
-					{
-						//SLL                      
-						puts("SLL" );
-						EX_MEM.ALUOutput = ID_EX.B << sa;
-						break;
-					}
-
-					case 0x00000002:
-					{
-						//SRL                      
-						puts("SRL" );
-						EX_MEM.ALUOutput = ID_EX.B >> sa;
-						break;
-					}			
-
-					case 0x00000003:
-					{
-						//SRA                      
-						puts("SRA" );
-						printf("\nB: %x\n", ID_EX.B );
-						EX_MEM.ALUOutput = extend_sign( ( ID_EX.B >> sa ) );
-						break;
-					}
-					case 0x0000000C:
-						//SYSCALL - System Call, exit the program.                      
-						puts("SYSCALL" );
-						//EX_MEM.ALUOutput = 0xA;
-						EX_MEM.type = 4;
-						break; 
-
-					case 0x00000013:
-						//MTLO
-						EX_MEM.type=5;
-						puts( "Move to LO" );
-						EX_MEM.LO = ID_EX.A;
-						NEXT_STATE.LO = ID_EX.A;
-						break;
-
-					case 0x0000011:
-						//MTHI
-						EX_MEM.type=5;
-						puts( "Move to HI" );
-						EX_MEM.HI = ID_EX.A;
-						NEXT_STATE.HI = ID_EX.A;
-						break;
-
-					case 0x0000012:
-						//MFLO
-						puts( "Move from LO" );
-						EX_MEM.ALUOutput = ID_EX.LO;  
-						printf("\nLO VALUE: %x", ID_EX.LO ); 
-						//CURRENT_STATE.REGS[rd] = NEXT_STATE.LO;
-						break;
-
-					case 0x0000010:
-						//MFHI
-						puts( "Move from HI" );
-						EX_MEM.ALUOutput = ID_EX.HI;
-						printf("\nHI VALUE: %x", ID_EX.HI );
-						//CURRENT_STATE.REGS[rd] = NEXT_STATE.HI;
-						break;
-					case 0x00000008:
-						{
-							//JR -
-							TAKE_JUMP = 1;
-							CNT_STALL = 1;
-							EX_MEM.DestReg = 0;
-							EX_MEM.RegWrite = 0;
-							EX_MEM.type = 6;
-							uint32_t temp = ID_EX.A;
-								temp = 0x004000bc;
-							EX_MEM.ALUOutput = temp;
-							NEXT_STATE.PC = temp;
-							//printf( "\n\nJR TO : %X", 0x004000bc );
-							break;
-						}
-					case 0x00000009:
-						{
-							//JALR -
-							TAKE_BRANCH = 1;
-							CNT_STALL = 1;
-							EX_MEM.DestReg = 0;
-							EX_MEM.RegWrite = 0;
-							uint32_t temp = ID_EX.A;
-								temp = 0x00400090;
-							EX_MEM.ALUOutput = temp - CURRENT_STATE.PC;
-							NEXT_STATE.PC = temp;
-							//NEXT_STATE.REGS[rd] = CURRENT_STATE.PC + 0x8;
-							break;
-						}
-
-				}
-				//prevInstruction = func;		
-				break;
-
-			}
-		case 0x08000000:
-			{
-				TAKE_JUMP = 1;
-				CNT_STALL = 1;
-				EX_MEM.DestReg = 0;
-				EX_MEM.RegWrite = 0;
-				EX_MEM.type = 6;
-
-				uint32_t target = ( 0x03FFFFFF & ID_EX.IR  );
-				uint32_t temp = target << 2;
-				uint32_t bits = ( CURRENT_STATE.PC & 0xF0000000 );
-
-				printf("\n\nJump INS:\n"
-					"Address: %x\n"
-					"CS.PC: %x\n", 
-					(bits | temp), CURRENT_STATE.PC );
-				
-				NEXT_STATE.PC = (bits | temp);
-				EX_MEM.ALUOutput = ( bits | temp );
-				break;
-			}
-
-		case 0x0C000000:
-			{
-				TAKE_JUMP = 1;
-				CNT_STALL = 1;
-				EX_MEM.DestReg = 0;
-				EX_MEM.RegWrite = 0;
-				EX_MEM.type = 6;
-				uint32_t target = ( 0x03FFFFFF & ID_EX.IR  );
-				uint32_t temp = target << 2;
-				uint32_t bits = ( CURRENT_STATE.PC & 0xF0000000 );
-				NEXT_STATE.PC = (bits | temp);
-				EX_MEM.ALUOutput = ( bits | temp );
-//				NEXT_STATE.REGS[sa] = CURRENT_STATE.PC + 0x8;
-				break;
-			}
-		default:
-			{
-				EX_MEM.DestReg = EX_MEM.RegisterRt;
-				EX_MEM.RegWrite = 1;
-
-				switch( oc )
-				{
-					case 0x20000000:
-						{	
-							//ADDI
-							puts( "ADDI" );
-							EX_MEM.ALUOutput =  ID_EX.imm + ID_EX.A;
-							EX_MEM.type = 1;
-							break;
-						}
-					case 0x24000000:
-						{	
-							//ADDIU
-							puts( "ADDIU" );
-							EX_MEM.ALUOutput =  ID_EX.imm + ID_EX.A;
-							EX_MEM.type = 1;
-							printf("\nEX->ADDIU: %s %s %u  \n", convert_Reg(rs), convert_Reg(rt), ID_EX.imm);
-							break;
-						}		
-					case 0xA0000000:
-						{
-							//SB - Store Byte 
-							puts("STORE BYTE" );
-							uint32_t eAddr = ID_EX.A + ID_EX.imm;              
-							EX_MEM.ALUOutput = eAddr;
-							EX_MEM.B = ID_EX.B;
-							EX_MEM.type = 3;
-							EX_MEM.RegWrite = 0;	
-							printf( "\n%x | STOREBYTEDATA-> rt(B): %x; rs(A): %x", ID_EX.IR, ID_EX.B , ID_EX.A );						      
-
-							uint32_t blocknum = ( eAddr & 0x000000F0 ) >> 4;
-							uint32_t tag 	  = ( eAddr & 0xFFFFFF00 );
-
-							CacheBlock getBlock = L1Cache.blocks[blocknum];
-							if( ( getBlock.tag == tag ) && ( getBlock.valid == 1 ) )
-							{
-								++cache_hits;
-							}
-							else
-							{
-								++cache_misses;
-								EX_MEM.CacheMiss = 1;
-							}
-							break;
-						}
-					case 0xAC000000:
-						{
-							//SW - Store Word
-							puts("STORE WORD" );
-						        uint32_t eAddr = ID_EX.A + ID_EX.imm;              
-						        EX_MEM.ALUOutput = eAddr;
-						        EX_MEM.B = ID_EX.B;
-							EX_MEM.type = 3;
-							EX_MEM.RegWrite = 0;
-							printf( "\n%x | STOREWORDDATA-> rt(B): %x; rs(A): %x", ID_EX.IR, ID_EX.B , ID_EX.A );
-
-							uint32_t blocknum = ( eAddr & 0x000000F0 ) >> 4;
-							uint32_t tag 	  = ( eAddr & 0xFFFFFF00 );
-
-							CacheBlock getBlock = L1Cache.blocks[blocknum];
-							if( ( getBlock.tag == tag ) && ( getBlock.valid == 1 ) )
-							{
-								++cache_hits;
-								EX_MEM.CacheMiss = 0;
-							}
-							else
-							{
-								++cache_misses;
-								EX_MEM.CacheMiss = 1;
-							}
-							break;
-						}
-					case 0xA4000000:
-						{
-							//SH - Store Halfword  
-							puts("STORE HALFWORD" );
-						      	uint32_t eAddr = ID_EX.A +ID_EX.imm;  
-						      	EX_MEM.ALUOutput = eAddr;
-						        EX_MEM.B = ID_EX.B;
-              						EX_MEM.type = 3;
-							EX_MEM.RegWrite = 0;
-
-							uint32_t blocknum = ( eAddr & 0x000000F0 ) >> 4;
-							uint32_t tag 	  = ( eAddr & 0xFFFFFF00 );
-
-							CacheBlock getBlock = L1Cache.blocks[blocknum];
-							if( ( getBlock.tag == tag ) && ( getBlock.valid == 1 ) )
-							{
-								++cache_hits;
-								EX_MEM.CacheMiss = 0;
-							}
-							else
-							{
-								++cache_misses;
-								EX_MEM.CacheMiss = 1;
-							}
-							break;
-						}
-					case 0x8C000000:
-						{	
-							//LW - Load Word
-							puts("LOAD WORD" );
-						      	uint32_t eAddr = ID_EX.A + ID_EX.imm;              
-						      	EX_MEM.ALUOutput = eAddr;
-						      	EX_MEM.type = 2;
-
-							uint32_t blocknum = ( eAddr & 0x000000F0 ) >> 4;
-							uint32_t tag 	  = ( eAddr & 0xFFFFFF00 );
-
-							CacheBlock getBlock = L1Cache.blocks[blocknum];
-							if( ( getBlock.tag == tag ) && ( getBlock.valid == 1 ) )
-							{
-								++cache_hits;
-								EX_MEM.CacheMiss = 0;
-							}
-							else
-							{
-								++cache_misses;
-								EX_MEM.CacheMiss = 1;
-							}
-
-							break;
-						}	
-					case 0x80000000:
-						{	
-							//LB - Load Byte  
-							puts("LOAD BYTE" );
-						      	uint32_t eAddr = ID_EX.A + ID_EX.imm;              
-						      	EX_MEM.ALUOutput = eAddr;
-						      	EX_MEM.type = 2;
-
-							uint32_t blocknum = ( eAddr & 0x000000F0 ) >> 4;
-							uint32_t tag 	  = ( eAddr & 0xFFFFFF00 );
-
-							CacheBlock getBlock = L1Cache.blocks[blocknum];
-							if( ( getBlock.tag == tag ) && ( getBlock.valid == 1 ) )
-							{
-								++cache_hits;
-								EX_MEM.CacheMiss = 0;
-							}
-							else
-							{
-								++cache_misses;
-								EX_MEM.CacheMiss = 1;
-							}
-
-							printf( "\n->> LoadByteFrom-> %x", eAddr );
-							break;
-						}
-					case 0x84000000:
-						{	
-							//LH - Load Halfword
-							puts("LOAD HALFWORD" );
-						      	uint32_t eAddr = ID_EX.A + ID_EX.imm;              
-						      	EX_MEM.ALUOutput = eAddr;
-							EX_MEM.type = 2;
-
-							uint32_t blocknum = ( eAddr & 0x000000F0 ) >> 4;
-							uint32_t tag 	  = ( eAddr & 0xFFFFFF00 );
-
-							CacheBlock getBlock = L1Cache.blocks[blocknum];
-							if( ( getBlock.tag == tag ) && ( getBlock.valid == 1 ) )
-							{
-								++cache_hits;
-								EX_MEM.CacheMiss = 0;
-							}
-							else
-							{
-								++cache_misses;
-								EX_MEM.CacheMiss = 1;
-							}
-
-							break;
-
-						}
-					case 0x30000000:
-						//ANDI
-						{                                           
-							puts("ANDI" );
-							///zero extend immediate then and it with rs
-							 EX_MEM.ALUOutput = (ID_EX.imm & 0x0000FFFF) & ID_EX.A;	
-							EX_MEM.type = 1;
-							break;
-						}
-					case 0x3C000000:
-						{	
-							//LUI - Load Upper Immediate
-							puts("LOAD IMMEDIATE UPPER" );
-							//Load data from instruction into rt register
-							 EX_MEM.ALUOutput = (ID_EX.imm << 16);
-							EX_MEM.type = 1;
-							break;
-						}
-
-					case 0x38000000:
-						//XORI
-						{                                                   
-							puts("XORI" );
-							///zero extend immediate then and it with rs
-							EX_MEM.ALUOutput = (ID_EX.imm & 0x0000FFFF) ^ ID_EX.A;
-							EX_MEM.type = 1;
-							break;
-						}
-					case 0x34000000:
-						//ORI
-						{           
-							puts("ORI" );
-							///zero extend immediate then and it with rs
-							EX_MEM.ALUOutput  = (ID_EX.imm & 0x0000FFFF) | ID_EX.A;	
-							EX_MEM.type = 1;
-							break;
-						}
-					case 0x28000000:
-						//SLTI                      
-						puts("SLTI" );
-						EX_MEM.type = 1;
-						if( ID_EX.A < extend_sign( ID_EX.imm ) )
-							EX_MEM.ALUOutput = 0x00000001;
-						else
-							EX_MEM.ALUOutput = 0x00000000;
-						break;
-					case 0x10000000:	
-						{             
-							puts("BEQ" );
-							//BEQ
-							EX_MEM.DestReg = 0;
-							EX_MEM.RegWrite = 0;
-							EX_MEM.type = 6;		
-
-							if( ID_EX.A == ID_EX.B )
-							{
-								TAKE_BRANCH = 1;
-								uint32_t target = extend_sign( ID_EX.imm << 2 );
-								//uint32_t bits = ( ID_EX.PC & 0xF0000000 );
-								EX_MEM.ALUOutput = ( ID_EX.PC + target );
-								NEXT_STATE.PC = ( ID_EX.PC + target );
-
-								puts("Taking Branch Equal");
-							}
-							else
-							{
-								TAKE_BRANCH = 0;
-							}
-
-							break;
-						}
-					case 0x14000000:	
-						{
-							puts("BNE" );
-							//BNE - Branch on Not Equal
-							CNT_STALL = 1;
-							EX_MEM.DestReg = 0;
-							EX_MEM.RegWrite = 0;
-							EX_MEM.type = 6;
-							
-							if( ID_EX.A != ID_EX.B )
-							{
-								TAKE_BRANCH = 1;
-								uint32_t target = extend_sign( ID_EX.imm << 2 );
-								//uint32_t bits = ( ID_EX.PC & 0xF0000000 );
-								EX_MEM.ALUOutput = ( ID_EX.PC + target );
-								NEXT_STATE.PC = ( ID_EX.PC + target );
-								CURRENT_STATE.PC = ( ID_EX.PC + target );
-								puts("Taking Branch NOT Equal");
-							}
-							else
-							{
-								TAKE_BRANCH = 0;
-							}
-
-							break;
-						}
-					case 0x18000000:	
-						{
-							puts("BLEZ" );
-							//BLEZ - Branch on Less Than or Equal to Zero
-							CNT_STALL = 1;
-							EX_MEM.DestReg = 0;
-							EX_MEM.RegWrite = 0;
-							EX_MEM.type = 6;		
-
-							if( ( ID_EX.A & 0x80000000 ) || ( ID_EX.A == 0 ) )
-							{
-								TAKE_BRANCH = 1;
-								uint32_t target = extend_sign( ID_EX.imm << 2 );
-								//uint32_t bits = ( ID_EX.PC & 0xF0000000 );
-								EX_MEM.ALUOutput = ( ID_EX.PC + target );
-								NEXT_STATE.PC = ( ID_EX.PC + target );
-								CURRENT_STATE.PC = ( ID_EX.PC + target );
-								puts("Taking Branch Less Than Equal");
-							}
-							else
-							{
-								TAKE_BRANCH = 0;
-							}
-							break;
-						}
-					case 0x1C000000:	
-						{
-							puts("BGTZ" );
-							//BGTZ - Branch on Greater Than Zero
-							CNT_STALL = 1;
-							EX_MEM.DestReg = 0;
-							EX_MEM.RegWrite = 0;
-							EX_MEM.type = 6;		
-
-							if( !( ID_EX.A & 0x80000000 ) || ( ID_EX.A != 0 ) )
-							{
-								TAKE_BRANCH = 1;
-								uint32_t target = extend_sign( ID_EX.imm << 2 );
-								//uint32_t bits = ( ID_EX.PC & 0xF0000000 );
-								EX_MEM.ALUOutput = ( ID_EX.PC + target );
-								NEXT_STATE.PC = ( ID_EX.PC + target );
-								CURRENT_STATE.PC = ( ID_EX.PC + target );
-							}
-							else
-							{
-								TAKE_BRANCH = 0;
-							}
-							break;
-						}
-					case 0x04000000:	
-						{
-							//REGIMM
-							switch( rt )
-							{
-								case 0x00000000:
-									{
-										puts("BLTZ" );
-										//BLTZ - Branch on Less Than Zero
-										CNT_STALL = 1;
-										EX_MEM.DestReg = 0;
-										EX_MEM.RegWrite = 0;
-										EX_MEM.type = 6;		
-
-										if( ID_EX.A & 0x80000000 )
-										{
-											TAKE_BRANCH = 1;
-											uint32_t target = extend_sign( ID_EX.imm << 2 );
-											//uint32_t bits = ( ID_EX.PC & 0xF0000000 );
-											EX_MEM.ALUOutput = ( ID_EX.PC + target );
-											NEXT_STATE.PC = ( ID_EX.PC + target );
-											CURRENT_STATE.PC = ( ID_EX.PC + target );
-										}
-										else
-										{
-											TAKE_BRANCH = 0;
-										}
-										break;
-									}
-								case 0x00000001:
-									{
-										puts("BGEZ" );
-										//BGEZ - Branch on Greater Than or Equal to Zero
-										CNT_STALL = 1;
-										EX_MEM.DestReg = 0;
-										EX_MEM.RegWrite = 0;
-										EX_MEM.type = 6;		
-
-										if( !( ID_EX.A & 0x80000000 ) )
-										{
-											TAKE_BRANCH = 1;
-											uint32_t target = extend_sign( ID_EX.imm << 2 );
-											//uint32_t bits = ( ID_EX.PC & 0xF0000000 );
-											EX_MEM.ALUOutput = ( ID_EX.PC + target );
-											NEXT_STATE.PC = ( ID_EX.PC + target );
-											CURRENT_STATE.PC = ( ID_EX.PC + target );
-										}
-										else
-										{
-											TAKE_BRANCH = 0;
-										}
-										break;
-									}
-							}
-							break;
-						}
-					
-				}
-
-			}
-
-	}
+	//class and destination were worked out when the word was decoded
+	EX_MEM.type = ID_EX.D.type;
+	EX_MEM.RegWrite = ID_EX.D.RegWrite;
+	EX_MEM.DestReg = ID_EX.D.DestReg;
+	ID_EX.D.handler( &ID_EX.D );
 
+	EVENT( EV_EX, EV_RUN, EV_REASON_NONE,
+		( ( ID_EX.D.type == 6 && TAKE_BRANCH ) ? EV_FLAG_BRANCH : 0 ) |
+		( ( ID_EX.D.uop == UOP_J || ID_EX.D.uop == UOP_JR || ID_EX.D.uop == UOP_JALR ) ? EV_FLAG_JUMP : 0 ),
+		ID_EX.PC, ID_EX.IR, EX_MEM.ALUOutput );
 }
 
 /************************************************************/
@@ -1189,34 +4254,33 @@ void EX()
 /************************************************************/
 void ID()
 {
+	TRACE_STAGE( IF_ID );
 	if( MEM_STALL > 0 )
 	{
+		EVENT( EV_ID, EV_STALL, EV_REASON_CACHE, 0, IF_ID.PC, IF_ID.IR, 0 );
 		return;
 	}
 
 	//Update EX INstruction     
   	ID_EX.IR = IF_ID.IR;
 	ID_EX.PC = IF_ID.PC;
+	ID_EX.D = IF_ID.D;
+	ID_EX.Filtered = IF_ID.Filtered;
 
 	//printf( "\nINS: %x\n", ID_EX.IR );
-                        
-	//opcode MASK: 1111 1100 0000 0000 4x0000 = FC0000000
-//	uint32_t oc = ( 0xFC000000 & ID_EX.IR  );
-	//rs MASK: 0000 0011 1110 0000 4x0000 = 03E00000
-	uint32_t rs = ( 0x03E00000 & ID_EX.IR  ) >> 21;
-	//rt MASK: 0000 0000 0001 1111 4x0000 = 001F0000;
-	uint32_t rt = ( 0x001F0000 & ID_EX.IR  ) >> 16;  
-	//rt MASK: 0000 0000 0001 1111 4x0000 = 001F0000;
-	uint32_t rd = ( 0x0000F800 & ID_EX.IR  ) >> 11;  
-	//rt MASK: 0000 0000 0001 1111 4x0000 = 001F0000;[400008]	STALL COUNT: 0
-	uint32_t imm = ( 0x0000FFFF & ID_EX.IR  );
+
+	//fields were pulled out when IF fetched the word
+	uint32_t rs = ID_EX.D.rs;
+	uint32_t rt = ID_EX.D.rt;
+	uint32_t rd = ID_EX.D.rd;
+	uint8_t forwarded = 0;
   
 	//Load data in ID->EX Buffer
 	ID_EX.A = CURRENT_STATE.REGS[rs];
 	ID_EX.B = CURRENT_STATE.REGS[rt];
 	ID_EX.LO = CURRENT_STATE.LO;
 	ID_EX.HI = CURRENT_STATE.HI;
-	ID_EX.imm = extend_sign( imm );
+	ID_EX.imm = ID_EX.D.imm;
 
 	ID_EX.RegisterRs = rs;
 	ID_EX.RegisterRt = rt;
@@ -1224,18 +4288,19 @@ void ID()
 
 	if( CNT_STALL > 0 )
 	{
-		puts( "->ID Stall" );
+		TRACE( TRACE_HAZARD, TRACE_INFO, "->ID Stall\n" );
 		ID_EX.A = NEXT_STATE.REGS[rs];
 		ID_EX.B = NEXT_STATE.REGS[rt];
 	}
 
 	if ( MEM_WB.RegWrite && (MEM_WB.DestReg != 0) && (MEM_WB.DestReg == ID_EX.RegisterRs))
 	{
-		puts( "Mem.Dest = Rs" );
+		TRACE( TRACE_HAZARD, TRACE_INFO, "Mem.Dest = Rs\n" );
 		if( ENABLE_FORWARDING == 1 )
 		{
 			ID_EX.A = MEM_WB.LMD;
 			ID_EX.B = NEXT_STATE.REGS[rt];
+			forwarded = EV_FLAG_FWD_MEM;
 		}
 		else
 		{
@@ -1244,11 +4309,12 @@ void ID()
 	}
 	else if ( MEM_WB.RegWrite && (MEM_WB.DestReg != 0) && (MEM_WB.DestReg == ID_EX.RegisterRt))
 	{
-		puts( "Mem.Dest = Rt" );
+		TRACE( TRACE_HAZARD, TRACE_INFO, "Mem.Dest = Rt\n" );
 		if( ENABLE_FORWARDING == 1 )
 		{
 			ID_EX.B = MEM_WB.LMD;
 			ID_EX.A = NEXT_STATE.REGS[rs];
+			forwarded = EV_FLAG_FWD_MEM;
 		}
 		else
 		{
@@ -1257,12 +4323,13 @@ void ID()
 	}
 	else if ( EX_MEM.RegWrite && (EX_MEM.DestReg != 0) && (EX_MEM.DestReg == ID_EX.RegisterRs) )
 	{
-		puts( "Ex.Dest = Rs" );
+		TRACE( TRACE_HAZARD, TRACE_INFO, "Ex.Dest = Rs\n" );
 		if( ENABLE_FORWARDING == 1 )
 		{
 			ID_EX.A = EX_MEM.ALUOutput;
 			ID_EX.B = NEXT_STATE.REGS[rt];
-			printf( "Forward to ID_EX.A from ALU = %x", EX_MEM.ALUOutput );
+			forwarded = EV_FLAG_FWD_EX;
+			TRACE( TRACE_HAZARD, TRACE_INFO, "Forward to ID_EX.A from ALU = %x", EX_MEM.ALUOutput );
 			CNT_STALL = 0;
 		} else {
 			CNT_STALL = 2;
@@ -1271,12 +4338,13 @@ void ID()
 	else if ( EX_MEM.RegWrite && (EX_MEM.DestReg != 0) && (EX_MEM.DestReg == ID_EX.RegisterRt))
 	{
 
-		puts( "Ex.Dest = Rt" );
+		TRACE( TRACE_HAZARD, TRACE_INFO, "Ex.Dest = Rt\n" );
 		if( ENABLE_FORWARDING == 1 )
 		{
 			ID_EX.A = NEXT_STATE.REGS[rs];
 			ID_EX.B = EX_MEM.ALUOutput;
-			printf( "Forward to ID_EX.B from ALU = %x", EX_MEM.ALUOutput );
+			forwarded = EV_FLAG_FWD_EX;
+			TRACE( TRACE_HAZARD, TRACE_INFO, "Forward to ID_EX.B from ALU = %x", EX_MEM.ALUOutput );
 			CNT_STALL = 0;
 		} else {
 			CNT_STALL = 2;
@@ -1296,6 +4364,7 @@ void ID()
 	{
 		//puts("Sending Blank INS");
 		ID_EX.IR = 0;
+		ID_EX.D = DECODE_BUBBLE;
 		ID_EX.A = 0;
 		ID_EX.B = 0;
 		ID_EX.LO = 0;
@@ -1306,7 +4375,19 @@ void ID()
 		ID_EX.RegisterRd = 0;
 	}
 
-	printf( "\n\nREADING: rs: %x; rt: %x; imm: %x\n", ID_EX.A, ID_EX.B, ID_EX.imm );
+	TRACE( TRACE_DECODE, TRACE_DEBUG, "\n\nREADING: rs: %x; rt: %x; imm: %x\n", ID_EX.A, ID_EX.B, ID_EX.imm );
+
+	if( IF_ID.IR == 0 )
+		EVENT( EV_ID, EV_BUBBLE, EV_REASON_NONE, 0, IF_ID.PC, 0, 0 );
+	else if( CNT_STALL > 0 )
+		EVENT( EV_ID, EV_STALL, EV_REASON_HAZARD, forwarded, IF_ID.PC, IF_ID.IR, 0 );
+	else if( TAKE_BRANCH == 1 || TAKE_JUMP == 1 )
+	{
+		TAKE_BRANCH == 1 ? STAT(BRANCH_FLUSHES) : STAT(JUMP_FLUSHES);
+		EVENT( EV_ID, EV_FLUSH, EV_REASON_NONE, forwarded, IF_ID.PC, IF_ID.IR, 0 );
+	}
+	else
+		EVENT( EV_ID, EV_RUN, EV_REASON_NONE, forwarded, IF_ID.PC, IF_ID.IR, ID_EX.A );
 
 }
 
@@ -1316,50 +4397,86 @@ void ID()
 /************************************************************/
 void IF()
 {
+	TRACE_PASS = TRACE_FILTER.in_window && !trace_filtered( CURRENT_STATE.PC, FALSE );
 	if( MEM_STALL > 0 )
 	{
+		EVENT( EV_IF, EV_STALL, EV_REASON_CACHE, 0, CURRENT_STATE.PC, 0, 0 );
 		return;
 	}
 
-	printf( "\n[%x]	STALL COUNT: %d;\n", CURRENT_STATE.PC, CNT_STALL );
-	print_instruction( CURRENT_STATE.PC );
-	printf( "\n" );
+	if( TRACE_ON( TRACE_FETCH, TRACE_INFO ) )
+	{
+		char text[64];
+
+		isa_disasm( text, sizeof( text ), mem_fetch_32( CURRENT_STATE.PC ) );
+		TRACE( TRACE_FETCH, TRACE_INFO, "\n[%x]	STALL COUNT: %d;\n%s\n", CURRENT_STATE.PC, CNT_STALL, text );
+	}
 
 	if( CNT_STALL > 0 )
 	{
-		puts( "->IF Stall" );
+		TRACE( TRACE_HAZARD, TRACE_INFO, "->IF Stall\n" );
+		STAT(HAZARD_STALLS);
+		EVENT( EV_IF, EV_STALL, EV_REASON_HAZARD, 0, CURRENT_STATE.PC, 0, 0 );
 		--CNT_STALL;
 	}
+	else if( PIPE_DRAINING )
+	{
+		//fetch nothing new; remember where fetching would resume
+		if( TAKE_BRANCH == 1 || TAKE_JUMP == 1 )
+		{
+			TAKE_BRANCH = 0;
+			TAKE_JUMP = 0;
+		}
+		else
+		{
+			NEXT_STATE.PC = CURRENT_STATE.PC;
+		}
+		IF_ID.PC = 0;
+		IF_ID.IR = 0;
+		IF_ID.D = DECODE_BUBBLE;
+		IF_ID.Filtered = TRACE_FILTER.select;
+		TRACE_STAGE( IF_ID );
+		EVENT( EV_IF, EV_BUBBLE, EV_REASON_DRAIN, 0, NEXT_STATE.PC, 0, 0 );
+	}
 	else	
 	{
 		if( TAKE_BRANCH == 1 )
 		{
-			puts( "Taking Branch" );
+			TRACE( TRACE_FETCH, TRACE_INFO, "Taking Branch\n" );
 			//NEXT_STATE.PC = MEM_WB.PC + MEM_WB.ALUOutput;
 		    	IF_ID.PC = NEXT_STATE.PC;
-			uint32_t ins = mem_read_32( NEXT_STATE.PC );
-		  	IF_ID.IR = ins;
+			IF_ID.D = *decode_fetch( NEXT_STATE.PC );
+		  	IF_ID.IR = IF_ID.D.IR;
 			TAKE_BRANCH = 0;
 			NEXT_STATE.PC = CURRENT_STATE.PC + 0x4;
+			IF_ID.Filtered = trace_filtered( IF_ID.PC, TRUE );
+			TRACE_STAGE( IF_ID );
+			EVENT( EV_IF, EV_RUN, EV_REASON_NONE, EV_FLAG_BRANCH, IF_ID.PC, IF_ID.IR, 0 );
 		}
 		else if( TAKE_JUMP == 1 )
 		{
-			puts( "Taking Jump" );
+			TRACE( TRACE_FETCH, TRACE_INFO, "Taking Jump\n" );
 			//NEXT_STATE.PC = MEM_WB.ALUOutput;
 		    	IF_ID.PC = NEXT_STATE.PC;
-			uint32_t ins = mem_read_32( NEXT_STATE.PC );
-		  	IF_ID.IR = ins;
+			IF_ID.D = *decode_fetch( NEXT_STATE.PC );
+		  	IF_ID.IR = IF_ID.D.IR;
 			TAKE_JUMP = 0;
+			IF_ID.Filtered = trace_filtered( IF_ID.PC, TRUE );
+			TRACE_STAGE( IF_ID );
+			EVENT( EV_IF, EV_RUN, EV_REASON_NONE, EV_FLAG_JUMP, IF_ID.PC, IF_ID.IR, 0 );
 		}
 		else
 		{
 			NEXT_STATE.PC = CURRENT_STATE.PC + 0x4;
 		    	IF_ID.PC = CURRENT_STATE.PC;
-			uint32_t ins = mem_read_32(  CURRENT_STATE.PC );
-		  	IF_ID.IR = ins;
+			IF_ID.D = *decode_fetch( CURRENT_STATE.PC );
+		  	IF_ID.IR = IF_ID.D.IR;
+			IF_ID.Filtered = trace_filtered( IF_ID.PC, TRUE );
+			TRACE_STAGE( IF_ID );
+			EVENT( EV_IF, EV_RUN, EV_REASON_NONE, 0, IF_ID.PC, IF_ID.IR, 0 );
 		}
 	}
-	printf( "TAKE_BRANCH: %d;\n", TAKE_BRANCH );
+	TRACE( TRACE_FETCH, TRACE_DEBUG, "TAKE_BRANCH: %d;\n", TAKE_BRANCH );
 }
 
 
@@ -1495,313 +4612,12 @@ void print_program(){
 }
 
 void print_instruction( uint32_t addr ){
-//Get the current instruction
-    uint32_t ins = mem_read_32( addr );
-    //uint32_t ins = addr;
-    //opcode MASK: 1111 1100 0000 0000 4x0000 = FC0000000
-    uint32_t oc = ( 0xFC000000 & ins  );
-	//printf( "BATNMA: %x\n", oc );
-
-    //Handle each case for instructions
-    switch( oc )
-    {
-            //R-Type
-        case 0x00000000:
-        {
-            //rs MASK: 0000 0011 1110 0000 4x0000 = 03E00000
-            uint32_t rs = ( 0x03E00000 & ins  ) >> 21;
-            //rt MASK: 0000 0000 0001 1111 4x0000 = 001F0000;
-            uint32_t rt = ( 0x001F0000 & ins  ) >> 16;
-            //rd MASK: 4x0000 1111 1000 0000 0000 = 0000F800;
-            uint32_t rd = ( 0x0000F800 & ins  ) >> 11;
-            //sa MASK: 4X0000 0000 0111 1100 0000 = 000007C0;
-            uint32_t sa = ( 0x000007C0 & ins  ) >> 6;
-            //func MASK: 6x0000 0001 1111 = 0000001F
-            uint32_t func = ( 0x0000003F & ins );
-            
-            switch( func )
-            {
-                case 0x00000020:
-                    //ADD
-                    printf( "ADD %s, %s, %s", convert_Reg(rd), convert_Reg(rs), convert_Reg(rt));
-                    break;
-                    
-                case 0x00000021:
-                    //ADDU
-                    printf( "ADDU %s, %s, %s", convert_Reg(rd), convert_Reg(rs), convert_Reg(rt));
-                    break;
-                    
-                case 0x00000022:
-                    //SUB
-                    printf( "SUB %s, %s, %s", convert_Reg(rd), convert_Reg(rs), convert_Reg(rt));
-                    break;
-                    
-                case 0x00000023:
-                    //SUBU
-                    //puts( "Subtract Unsigned Function" );
-                    printf( "SUBU %s, %s, %s", convert_Reg(rd), convert_Reg(rs), convert_Reg(rt));
-                    break;
-                    
-                case 0x00000018:
-                {
-                    //MULT
-                    printf( "MULT %s, %s", convert_Reg(rs), convert_Reg(rt));
-                    break;
-                }
-                    
-                case 0x00000019:
-                {
-                    //MULTU
-                    printf( "MULTU %s, %s", convert_Reg(rs), convert_Reg(rt));
-                    break;
-                }
-                    
-                case 0x0000001A:
-                    //DIV
-                    printf( "DIV %s, %s", convert_Reg(rs), convert_Reg(rt));
-                    break;
-                    
-                case 0x0000001B:
-                    //DIVU
-                    printf( "DIVU %s, %s", convert_Reg(rs), convert_Reg(rt));
-                    break;
-                    
-                case 0X00000024:
-                    //AND
-                    printf( "AND %s, %s, %s", convert_Reg(rd), convert_Reg(rs), convert_Reg(rt));
-                    break;
-                    
-                case 0X00000025:
-                    //OR
-                    printf( "OR %s, %s, %s", convert_Reg(rd), convert_Reg(rs), convert_Reg(rt));
-                    break;
-                    
-                case 0X00000026:
-                    //XOR
-                    printf( "XOR %s, %s, %s", convert_Reg(rd), convert_Reg(rs), convert_Reg(rt));
-                    break;
-                    
-                case 0x00000027:
-                    //NOR
-                    printf( "NOR %s, %s, %s", convert_Reg(rd), convert_Reg(rs), convert_Reg(rt));
-                    break;
-                    
-                case 0x0000002A:
-                    //SLT
-                    printf( "SLTs %s, %s, 0x%x", convert_Reg(rd), convert_Reg(rs), rt);
-                    break;
-                    
-                case 0x00000000:
-                {
-                    //SLL
-                    printf( "SLL %s, %s, 0x%x", convert_Reg(rd), convert_Reg(rs), sa);
-                    break;
-                }
-                    
-                case 0x00000002:
-                {
-                    //SRL
-                    printf( "SRL %s, %s, 0x%x", convert_Reg(rd), convert_Reg(rs), sa);
-                    break;
-                }
-                    
-                case 0x00000003:
-                {
-                    //SRA
-                    printf( "SRA %s, %s, 0x%x", convert_Reg(rd), convert_Reg(rs), sa);
-                    break;
-                }
-                case 0x0000000C:
-                    //SYSCALL - System Call, exit the program.
-                    printf( "SYSCALL");
-                    break;
-                    
-                case 0x00000008:
-                    //JR
-                    printf( "JR %s", convert_Reg(rs));
-                    break;
-                case 0x00000009:
-                    //JALR
-                    printf( "JALR %s, %s", convert_Reg(rd), convert_Reg(rs));
-                    break;
-                    
-                case 0x00000013:
-                    //MTLO
-                    printf( "MTLO %s", convert_Reg(rs));
-                    break;
-                    
-                case 0x0000011:
-                    //MTHI
-                    printf( "MTHI %s", convert_Reg(rs));
-                    break;
-                    
-                case 0x0000012:
-                    //MFLO
-                    printf( "MFLO %s", convert_Reg(rd));
-                    break;
-                    
-                case 0x0000010:
-                    //MFHI
-                    printf( "MFHI %s", convert_Reg(rd));
-                    break;
-            }
-            break;
-            
-        }
-        case 0x0C000000:
-        {
-            //JAL-Jump and Link Instruction
-            uint32_t target = ( 0x03FFFFFF & ins  );
-            printf( "JAL %x", target );
-            break;
-        }
-        case 0x08000000:
-        {
-            //J-Jump
-            uint32_t target = ( 0x03FFFFFF & ins  );
-            printf( "J %x", target);
-            break;
-        }
-        default:
-        {
-            
-            //rs MASK: 0000 0011 1110 0000 4x0000 = 03E00000
-            uint32_t rs = ( 0x03E00000 & ins  ) >> 21;
-            //rt MASK: 0000 0000 0001 1111 4x0000 = 001F0000;
-            uint32_t rt = ( 0x001F0000 & ins  ) >> 16;
-            //Immediate MASK: 4x0000 4x1111 = 0000FFFF;
-            uint32_t im = ( 0x0000FFFF & ins  );
-            
-            switch( oc )
-            {
-                case 0x20000000:
-                {
-                    //ADDI
-                    printf( "ADDI %s, %s, 0x%x", convert_Reg(rt), convert_Reg(rs), im);
-                    break;
-                }
-                case 0x24000000:
-                {
-                    //ADDIU
-                    printf( "ADDIU %s, %s, 0x%x", convert_Reg(rt), convert_Reg(rs), im );
-                    break;
-                }
-                case 0xA0000000:
-                {
-                    //SB - Store Byte
-                    printf( "SB %s, 0x%x(%s)", convert_Reg(rt), im, convert_Reg(rs));
-                    break;
-                }
-                case 0xAC000000:
-                {
-                    //SW - Store Word
-                    printf( "SW %s, 0x%x(%s)", convert_Reg(rt), im, convert_Reg(rs));
-                    break;
-                }
-                case 0xA4000000:
-                {
-                    //SH - Store Halfword
-                    printf( "SH %s, 0x%x(%s)", convert_Reg(rt), im, convert_Reg(rs));
-                    break;
-                }
-                case 0x38000000:
-                {
-                    //XORI - XORI w/
-                    printf( "XORI %s,%s 0x%x", convert_Reg(rt),convert_Reg(rs), im);
-                    break;
-                }
-		case 0x28000000:
-                {
-                    //SLTI 
-                    printf( "SLTI %s,%s 0x%x", convert_Reg(rt),convert_Reg(rs), im);
-                    break;
-                }
-                case 0x8C000000:
-                {
-                    //LW - Load Word
-                    printf( "LW %s, 0x%x(%s)", convert_Reg(rt), im, convert_Reg(rs));
-                    break;
-                }
-                case 0x80000000:
-                {
-                    //LB - Load Byte
-                    printf( "LB %s, 0x%x(%s)", convert_Reg(rt), im, convert_Reg(rs));
-                    break;
-                }
-                case 0x84000000:
-                {
-                    //LH - Load Halfword
-                    printf( "LH %s, 0x%x(%s)", convert_Reg(rt), im, convert_Reg(rs));
-                    break;
-                    
-                }
-                case 0x30000000:
-                {
-                    //ANDI
-                    printf( "ANDI %s, %s, 0x%x", convert_Reg(rt), convert_Reg(rs), im);
-                    break;
-                }
-                case 0x3C000000:
-                {
-                    //LUI - Load Upper Immediate
-                    printf( "LUI %s, 0x%x", convert_Reg(rt), im);
-                    break;
-                }
-                case 0x10000000:
-                {
-                    //BEQ
-                    printf( "BEQ %s, %s, 0x%x", convert_Reg(rs), convert_Reg(rt), im );
-                    break;
-                }
-                case 0x14000000:
-                {
-                    //BNE - Branch on Not Equal
-                    printf( "BNE %s, %s, 0x%x", convert_Reg(rs), convert_Reg(rt), im );
-                    break;
-                }
-                case 0x18000000:
-                {
-                    //BLEZ - Branch on Less Than or Equal to Zero
-                    printf( "BLEZ %s, 0x%x", convert_Reg(rs), im);
-                    break;
-                }
-                case 0x1C000000:
-                {
-                    //BGTZ - Branch on Greater Than Zero
-                    printf( "BGTZ %s, 0x%x", convert_Reg(rs), im);
-                    break;
-                }
-                case 0x34000000:
-                {
-                    //ORI
-                    printf( "ORI %s, %s, 0x%x", convert_Reg(rs), convert_Reg(rt), im);
-                    break;
-                }
-                case 0x04000000:
-                {
-                    //REGIMM
-                    switch( rt )
-                    {
-                        case 0x00000000:
-                        {
-                            //BLTZ - Branch on Less Than Zero
-                            printf( "BLTZ %s, 0x%x", convert_Reg(rs), im);
-                            break;
-                        }
-                        case 0x00000001:
-                        {
-                            //BGEZ - Branch on Greater Than or Equal to Zero
-                            printf( "BGEZ %s, 0x%x", convert_Reg(rs), im);
-                            break;
-                        }
-                    }
-                    break;
-                }
-            }
-            
-        }
-            
-    }
+	char text[64];
+
+	//Operands are laid out by the ISA_FMT_* of the instruction's row; read
+	//as a fetch so data watchpoints and the data heatmap are left alone
+	isa_disasm( text, sizeof( text ), mem_fetch_32( addr ) );
+	printf( "%s", text );
 }
 
 /************************************************************/
@@ -1809,27 +4625,32 @@ void print_instruction( uint32_t addr ){
 /************************************************************/
 void show_pipeline()
 {
+  char text[64];
 
   printf( "\nCurrent PC: %x ", CURRENT_STATE.PC );
   
   printf( "\n\nIF/ID.IR %x ", IF_ID.IR );
-  print_instruction( IF_ID.IR );
+  isa_disasm( text, sizeof( text ), IF_ID.IR );
+  printf( "%s", text );
   printf( "\nIF/ID.PC %x", IF_ID.PC );
   
   printf( "\n\nID/EX.IR %x ", ID_EX.IR );
-  print_instruction( ID_EX.IR );
+  isa_disasm( text, sizeof( text ), ID_EX.IR );
+  printf( "%s", text );
   printf( "\nID/EX.A %x", ID_EX.A );
   printf( "\nID/EX.B %x", ID_EX.B );
   printf( "\nID/EX.imm %d", ID_EX.imm );
   
   printf( "\n\nEX/MEM.IR %x ", EX_MEM.IR );  
-  print_instruction( EX_MEM.IR );
+  isa_disasm( text, sizeof( text ), EX_MEM.IR );
+  printf( "%s", text );
   printf( "\nEX/MEM.A %x", EX_MEM.A );
   printf( "\nEX/MEM.B %x", EX_MEM.B );
   printf( "\nEX/MEM.ALUOutput %x", EX_MEM.ALUOutput );
   
   printf( "\n\nMEM/WB.IR %x ", MEM_WB.IR );
-  print_instruction( MEM_WB.IR );
+  isa_disasm( text, sizeof( text ), MEM_WB.IR );
+  printf( "%s", text );
   printf( "\nMEM/WB.A %x", MEM_WB.ALUOutput );
   printf( "\nMEM/WB.B %x", MEM_WB.LMD );
   
@@ -1865,21 +4686,86 @@ BLEZ $t6
 /* main                                                                                                                                   */
 /***************************************************************/
 int main(int argc, char *argv[]) {                              
-	printf("\n**************************\n");
-	printf("Welcome to MU-MIPS SIM...\n");
-	printf("**************************\n\n");
+	int opt, run_all = FALSE, run_cycles = -1;
+	const char *script = NULL;
+
+	/* -r/-n/-s run without the command prompt and exit with a status */
+	while ((opt = getopt(argc, argv, "rn:s:qo:")) != -1) {
+		switch (opt) {
+			case 'r':
+				run_all = TRUE;
+				INTERACTIVE = FALSE;
+				break;
+			case 'n':
+				run_cycles = atoi(optarg);
+				INTERACTIVE = FALSE;
+				break;
+			case 's':
+				script = optarg;
+				INTERACTIVE = FALSE;
+				break;
+			case 'q':
+				QUIET = TRUE;
+				break;
+			case 'o':
+				if (!stats_request(optarg, strlen(optarg) > 4 && strcasecmp(optarg + strlen(optarg) - 4, ".csv") == 0 ? "csv" : "json")) {
+					exit(EXIT_ERROR);
+				}
+				break;
+			default:
+				usage(argv[0]);
+				exit(EXIT_ERROR);
+		}
+	}
+
+	if (!QUIET) {
+		printf("\n**************************\n");
+		printf("Welcome to MU-MIPS SIM...\n");
+		printf("**************************\n\n");
+	}
 	
-	if (argc < 2) {
-		printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
-		exit(1);
+	if (optind >= argc) {
+		printf("Error: You should provide input file.\n");
+		usage(argv[0]);
+		exit(EXIT_ERROR);
+	}
+	if (strlen(argv[optind]) >= sizeof(prog_file)) {
+		printf("Error: program path %s is too long\n", argv[optind]);
+		exit(EXIT_ERROR);
 	}
 
-	strcpy(prog_file, argv[1]);
+	strcpy(prog_file, argv[optind]);
+	CMD_IN = stdin;
+	if (QUIET) {
+		trace_set(TRACE_ALL, TRACE_OFF);
+	}
 	initialize();
 	load_program();
-	help();
-	while (1){
-		handle_command();
+
+	if (INTERACTIVE) {
+		if (!QUIET) {
+			help();
+		}
+		while (1){
+			handle_command();
+		}
+	}
+
+	if (script != NULL) {
+		CMD_IN = fopen(script, "r");
+		if (CMD_IN == NULL) {
+			printf("Error: Can't open command script %s\n", script);
+			exit(EXIT_ERROR);
+		}
+		while (handle_command()) {
+		}
+		fclose(CMD_IN);
+	}
+	if (run_all) {
+		runAll();
+	} else if (run_cycles >= 0) {
+		run(run_cycles);
 	}
+	sim_exit(FALSE);
 	return 0;
 }
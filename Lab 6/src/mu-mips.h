@@ -24,15 +24,18 @@
 
 typedef struct {
 	uint32_t begin, end;
-	uint8_t *mem;
+	const char *name;	/* used in footprint reports */
+	uint8_t *image;		/* file mapped into this region by mem_map_image(), or NULL */
+	uint32_t image_begin;	/* guest address of the first mapped byte */
+	size_t image_size;	/* length of the mapping in bytes (whole pages) */
 } mem_region_t;
 
-/* memory will be dynamically allocated at initialization */
+/* pages inside a region are allocated on first write (see mu-mem.h) */
 mem_region_t MEM_REGIONS[] = {
-	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL },
-	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL },
-	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL },
-	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL }
+	{ MEM_TEXT_BEGIN, MEM_TEXT_END, "text", NULL, 0, 0 },
+	{ MEM_DATA_BEGIN, MEM_DATA_END, "data", NULL, 0, 0 },
+	{ MEM_KDATA_BEGIN, MEM_KDATA_END, "kdata", NULL, 0, 0 },
+	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, "ktext", NULL, 0, 0 }
 };
 
 #define NUM_MEM_REGION 4
@@ -45,6 +48,23 @@ typedef struct CPU_State_Struct {
   uint32_t HI, LO;                          /* special regs for mult/div. */
 } CPU_State;
 
+/* An instruction word with its fields pulled out once, see mu-decode.h */
+typedef struct DecodedIns_Struct DecodedIns;
+struct DecodedIns_Struct {
+	uint32_t IR;
+	uint32_t imm;    //sign extended immediate
+	uint32_t target; //jump target field << 2
+	uint8_t opcode, func, rs, rt, rd, sa;
+	uint8_t type;    //pipeline class, as in CPU_Pipeline_Reg.type
+	uint8_t RegWrite;
+	uint8_t DestReg;
+	uint8_t size;    //load/store width in bytes
+	uint8_t valid;   //FALSE once the word has been overwritten
+	uint8_t uop;     //micro-op for the functional engine, see mu-block.h
+	uint8_t isa;     //ISA_* row, for the per-opcode stats
+	void (*handler)(const DecodedIns *d); //EX work for this instruction
+};
+
 typedef struct CPU_Pipeline_Reg_Struct{
 	uint32_t PC;
 	uint32_t IR;
@@ -62,6 +82,8 @@ typedef struct CPU_Pipeline_Reg_Struct{
 	uint32_t RegWrite;	
 	uint32_t DestReg;
 	uint32_t CacheMiss;
+	uint32_t Filtered;  //TRUE if TRACE_FILTER left this instruction out at fetch
+	DecodedIns D;  //decoded copy of IR, travels with the instruction
 } CPU_Pipeline_Reg;
 
 /***************************************************************/
@@ -77,6 +99,8 @@ int CNT_STALL = 0 ;
 int TAKE_BRANCH = 0;
 int TAKE_JUMP = 0;
 int MEM_STALL = 0;
+int MEM_WB_HELD = 0; /* MEM stalled last cycle, so WB sees the same MEM_WB again */
+int PIPE_DRAINING = 0; /* IF feeds bubbles so in-flight instructions can retire */
 uint32_t INSTRUCTION_COUNT;
 uint32_t CYCLE_COUNT;
 uint32_t PROGRAM_SIZE; /*in words*/
@@ -90,7 +114,16 @@ CPU_Pipeline_Reg ID_EX;
 CPU_Pipeline_Reg EX_MEM;
 CPU_Pipeline_Reg MEM_WB;
 
-char prog_file[32];
+char prog_file[256];
+
+/* Command-line run, see main() */
+#define EXIT_FINISHED 0 /* program reached SYSCALL */
+#define EXIT_STOPPED 2 /* cycle limit or watchpoint hit first */
+#define EXIT_ERROR 1 /* bad flags, unreadable program or out of memory */
+
+FILE *CMD_IN; /* commands for handle_command(): stdin or a -s script */
+int INTERACTIVE = 1; /* FALSE under -r/-n/-s: no prompt, exit with stats */
+int QUIET = 0; /* -q: no banner, menu, load messages or trace output */
 
 
 /***************************************************************/
@@ -103,12 +136,17 @@ void cycle();
 void run(int num_cycles);
 void runAll();
 void mdump(uint32_t start, uint32_t stop) ;
+void mdump_file(uint32_t start, uint32_t stop, const char *path, int hex);
+void mload(uint32_t start, const char *path, int hex);
 void rdump();
-void handle_command();
+int handle_command();
+void sim_exit(int goodbye);
+void usage(const char *name);
 void reset();
 void init_memory();
 void load_program();
 void handle_pipeline(); /*IMPLEMENT THIS*/
+void pipeline_drain();
 void WB();/*IMPLEMENT THIS*/
 void MEM();/*IMPLEMENT THIS*/
 void EX();/*IMPLEMENT THIS*/
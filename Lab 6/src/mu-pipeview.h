@@ -0,0 +1,174 @@
+/******************************************************************************/
+/* PIPELINE VIEWER EXPORT                                                     */
+/******************************************************************************/
+/* Turns the stage events of mu-event.h into a Kanata log, the native input  */
+/* of the Konata pipeline viewer. Every fetched instruction becomes one row  */
+/* with its F, D, X, M and W stages on the cycles it spent in them. Hazard   */
+/* and cache stalls, forwards, cache hits/misses and taken branches are      */
+/* attached as notes. Instructions squashed by a taken branch or jump are    */
+/* marked flushed, and the rest retire when they leave WB.                   */
+/*                                                                            */
+/* Instructions are followed through the latches: a stage event whose PC   */
+/* and IR match the instruction last seen one stage earlier moves it on. An */
+/* event that matches neither stage, such as the second pass of a load      */
+/* through MEM after a miss, is skipped.                                   */
+/*                                                                            */
+/* The simulator feeds events live with `pipeview <file>` and the output is */
+/* written through a large stdio buffer. mu-trace-dump -k converts a        */
+/* recorded event file the same way.                                        */
+/******************************************************************************/
+#define PV_EMPTY 0 //no instruction in the stage; ids start at 1
+#define PV_BUF_SIZE (1 << 20) //stdio buffer for the output file
+
+typedef struct PipeView_Struct {
+
+  FILE *fp; //NULL while no export is running
+  int started; //TRUE once the first cycle has been written
+  uint64_t cycle; //simulator cycle of the events being converted
+  uint64_t next_id; //Kanata id of the next fetched instruction
+  uint64_t retired; //retire ids handed out
+
+  uint64_t id[EV_NUM_STAGES]; //instruction in each stage, PV_EMPTY if none
+  uint32_t pc[EV_NUM_STAGES];
+  uint32_t ir[EV_NUM_STAGES];
+  uint8_t stalled[EV_NUM_STAGES]; //a stall note was already written for this stay
+
+} PipeView;
+
+const char *PV_STAGES[EV_NUM_STAGES] = { "F", "D", "X", "M", "W" };
+
+
+/***************************************************************/
+/* PIPELINE VIEW OBJECT                                        */
+/***************************************************************/
+PipeView PIPEVIEW;
+
+
+/***************************************************************/
+/* Conversion, shared by the simulator and mu-trace-dump       */
+/***************************************************************/
+static void pipeview_begin( PipeView *v, FILE *fp )
+{
+	memset( v, 0, sizeof( *v ) );
+	v->fp = fp;
+	v->next_id = 1;
+	fprintf( fp, "Kanata\t0004\n" );
+}
+
+/* Take the instruction out of stage s: retired from WB, flushed anywhere else */
+static void pipeview_leave( PipeView *v, int s, int flushed )
+{
+	uint64_t id = v->id[s];
+
+	if( id == PV_EMPTY )
+	{
+		return;
+	}
+	fprintf( v->fp, "E\t%llu\t0\t%s\n", (unsigned long long) id, PV_STAGES[s] );
+	fprintf( v->fp, "R\t%llu\t%llu\t%d\n", (unsigned long long) id, (unsigned long long) v->retired++, flushed );
+	v->id[s] = PV_EMPTY;
+}
+
+/* Put instruction id into stage s */
+static void pipeview_enter( PipeView *v, int s, uint64_t id, uint32_t pc, uint32_t ir )
+{
+	fprintf( v->fp, "S\t%llu\t0\t%s\n", (unsigned long long) id, PV_STAGES[s] );
+	v->id[s] = id;
+	v->pc[s] = pc;
+	v->ir[s] = ir;
+	v->stalled[s] = FALSE;
+}
+
+static void pipeview_event( PipeView *v, const PipeEvent *e )
+{
+	static const char *reasons[] = { "", "hazard", "cache miss", "drain" };
+	int s = e->stage, holds = ( e->ir != 0 && e->kind != EV_BUBBLE );
+	uint64_t id;
+	char text[64];
+
+	if( s >= EV_NUM_STAGES )
+	{
+		return;
+	}
+
+	//advance the clock; the simulator may restart its count after a fast-forward
+	if( !v->started )
+	{
+		fprintf( v->fp, "C=\t%llu\n", (unsigned long long) e->cycle );
+		v->started = TRUE;
+		v->cycle = e->cycle;
+	}
+	else if( e->cycle != v->cycle )
+	{
+		fprintf( v->fp, "C\t%llu\n", (unsigned long long) ( e->cycle > v->cycle ? e->cycle - v->cycle : 1 ) );
+		v->cycle = e->cycle;
+	}
+
+	//still the same instruction in this stage
+	if( holds && v->id[s] != PV_EMPTY && v->pc[s] == e->pc && v->ir[s] == e->ir )
+	{
+		id = v->id[s];
+	}
+	else
+	{
+		//whatever was here did not move on: WB retires it, other stages lost it
+		pipeview_leave( v, s, s != EV_WB );
+		if( !holds )
+		{
+			return;
+		}
+
+		if( s == EV_IF )
+		{
+			if( e->kind != EV_RUN )
+			{
+				return;
+			}
+			id = v->next_id++;
+			isa_disasm( text, sizeof( text ), e->ir );
+			fprintf( v->fp, "I\t%llu\t%llu\t0\n", (unsigned long long) id, (unsigned long long) id );
+			fprintf( v->fp, "L\t%llu\t0\t%08x: %s\n", (unsigned long long) id, e->pc, text );
+		}
+		else if( v->id[s - 1] != PV_EMPTY && v->pc[s - 1] == e->pc && v->ir[s - 1] == e->ir )
+		{
+			id = v->id[s - 1];
+			fprintf( v->fp, "E\t%llu\t0\t%s\n", (unsigned long long) id, PV_STAGES[s - 1] );
+			v->id[s - 1] = PV_EMPTY;
+		}
+		else
+		{
+			return;
+		}
+		pipeview_enter( v, s, id, e->pc, e->ir );
+	}
+
+	//notes shown when hovering over the instruction
+	if( e->kind == EV_STALL && !v->stalled[s] )
+	{
+		fprintf( v->fp, "L\t%llu\t1\t%s stalled (%s) at cycle %llu\\n\n", (unsigned long long) id, PV_STAGES[s],
+			reasons[e->reason & 3], (unsigned long long) e->cycle );
+		v->stalled[s] = TRUE;
+	}
+	if( e->flags & ( EV_FLAG_HIT | EV_FLAG_MISS ) )
+		fprintf( v->fp, "L\t%llu\t1\tL1Cache %s at 0x%08x\\n\n", (unsigned long long) id, ( e->flags & EV_FLAG_HIT ) ? "hit" : "miss", e->data );
+	if( e->flags & EV_FLAG_BRANCH && s == EV_EX )
+		fprintf( v->fp, "L\t%llu\t1\tbranch taken\\n\n", (unsigned long long) id );
+	if( e->flags & EV_FLAG_JUMP && s == EV_EX )
+		fprintf( v->fp, "L\t%llu\t1\tjump\\n\n", (unsigned long long) id );
+	if( e->flags & EV_FLAG_FWD_MEM )
+		fprintf( v->fp, "L\t%llu\t1\toperand forwarded from MEM/WB\\n\n", (unsigned long long) id );
+	if( e->flags & EV_FLAG_FWD_EX )
+		fprintf( v->fp, "L\t%llu\t1\toperand forwarded from EX/MEM\\n\n", (unsigned long long) id );
+
+	if( e->kind == EV_FLUSH )
+	{
+		pipeview_leave( v, s, TRUE );
+	}
+}
+
+/* Retire what is in WB and leave the rest open; the caller closes fp */
+static void pipeview_end( PipeView *v )
+{
+	pipeview_leave( v, EV_WB, FALSE );
+	v->fp = NULL;
+}
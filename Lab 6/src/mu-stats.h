@@ -0,0 +1,57 @@
+/******************************************************************************/
+/* STATISTICS REGISTRY                                                        */
+/******************************************************************************/
+/* Every pipeline counter is listed once in STAT_TABLE with the name it is  */
+/* exported under. The stages bump them with STAT(); per-opcode commit     */
+/* counts are kept alongside, indexed by the ISA_* row of mu-isa.h.        */
+/*                                                                            */
+/* `stats <file> <json|csv>` (or -o <file>) picks where the registry is      */
+/* written; it is dumped once when the simulator exits, together with the   */
+/* CPI. Fast-forwarding and `reset` clear it, as they do CYCLE_COUNT.       */
+/*                                                                            */
+/* Unlike INSTRUCTION_COUNT, which counts every WB call, "instructions"    */
+/* counts each instruction once when it leaves WB: bubbles and the WB      */
+/* repeats during an L1Cache miss are left out.                             */
+/******************************************************************************/
+#define STATS_JSON 0
+#define STATS_CSV  1
+
+#define STAT_TABLE(X) \
+	/* id              name              description */ \
+	X( CYCLES,         "cycles",         "pipeline cycles simulated" ) \
+	X( INSTRUCTIONS,   "instructions",   "instructions committed in WB" ) \
+	X( HAZARD_STALLS,  "stall_hazard",   "cycles IF held by CNT_STALL (data hazard or branch)" ) \
+	X( CACHE_STALLS,   "stall_cache",    "cycles MEM held by MEM_STALL (L1Cache miss)" ) \
+	X( BRANCH_FLUSHES, "flush_branch",   "fetched instructions squashed by a taken branch" ) \
+	X( JUMP_FLUSHES,   "flush_jump",     "fetched instructions squashed by a jump" ) \
+	X( LOAD_HITS,      "load_hits",      "loads that hit L1Cache" ) \
+	X( LOAD_MISSES,    "load_misses",    "loads that missed L1Cache" ) \
+	X( STORE_HITS,     "store_hits",     "stores that hit L1Cache" ) \
+	X( STORE_MISSES,   "store_misses",   "stores that missed L1Cache" )
+
+#define STAT_ENUM( id, name, desc ) STAT_##id,
+enum { STAT_TABLE( STAT_ENUM ) STAT_COUNT };
+
+#define STAT(id) ( ++STATS[STAT_##id] )
+
+
+/***************************************************************/
+/* STATISTICS OBJECT                                           */
+/***************************************************************/
+uint64_t STATS[STAT_COUNT];
+uint64_t STATS_OP[ISA_COUNT]; //instructions committed per ISA_* row
+
+#define STAT_NAME( id, name, desc ) name,
+const char *STAT_NAMES[STAT_COUNT] = { STAT_TABLE( STAT_NAME ) };
+
+char stats_file[256]; //empty while no export is requested
+int stats_format; //STATS_JSON or STATS_CSV
+
+
+/***************************************************************/
+/* Function Declerations.                                      */
+/***************************************************************/
+void stats_reset();
+double stats_cpi();
+int stats_request(const char *path, const char *format);
+void stats_export();
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define TRUE  1
+#define FALSE 0
+
+#include "mu-isa.h"
+#include "mu-event.h"
+#include "mu-pipeview.h"
+
+/************************************************************/
+/* Offline decoder for the binary pipeline events written by    */
+/* the simulator's `events` command.                                      */
+/*                                                                                        */
+/*   mu-trace-dump <file>       one line per stage event                 */
+/*   mu-trace-dump -p <file>    one show-style snapshot per cycle     */
+/*   mu-trace-dump -k <file>    Konata pipeline view on stdout         */
+/************************************************************/
+#define DUMP_CHUNK 4096 //events read per fread
+
+const char *STAGE_NAMES[EV_NUM_STAGES] = { "IF", "ID", "EX", "MEM", "WB" };
+const char *REASON_NAMES[] = { "", "hazard", "cache miss", "drain" };
+
+uint64_t KIND_COUNT[4];
+uint64_t REASON_COUNT[4];
+uint64_t HITS, MISSES;
+
+/************************************************************/
+/* Print pc, IR and what happened to one event, no newline              */
+/************************************************************/
+void print_event( const PipeEvent *e )
+{
+	char text[64];
+
+	isa_disasm( text, sizeof( text ), e->ir );
+	printf( "[0x%08x] %08x  %-24s", e->pc, e->ir, e->ir ? text : "" );
+
+	switch( e->kind )
+	{
+		case EV_BUBBLE:
+			printf( " bubble" );
+			break;
+		case EV_STALL:
+			printf( " stall" );
+			break;
+		case EV_FLUSH:
+			printf( " flushed" );
+			break;
+	}
+	if( e->reason != EV_REASON_NONE && e->reason <= EV_REASON_DRAIN )
+	{
+		printf( " (%s)", REASON_NAMES[e->reason] );
+	}
+
+	if( e->flags & EV_FLAG_HIT )
+		printf( " hit 0x%08x", e->data );
+	if( e->flags & EV_FLAG_MISS )
+		printf( " miss 0x%08x", e->data );
+	if( e->flags & EV_FLAG_BRANCH )
+		printf( " taking branch" );
+	if( e->flags & EV_FLAG_JUMP )
+		printf( " taking jump" );
+	if( e->flags & EV_FLAG_FWD_MEM )
+		printf( " forward from MEM/WB" );
+	if( e->flags & EV_FLAG_FWD_EX )
+		printf( " forward from EX/MEM" );
+
+	if( e->kind == EV_RUN && e->ir != 0 && ( e->stage == EV_EX || e->stage == EV_WB ) )
+	{
+		printf( " = 0x%x", e->data );
+	}
+}
+
+/************************************************************/
+/* Print the latches of one cycle like show_pipeline()                   */
+/************************************************************/
+void print_snapshot( uint64_t cycle, const PipeEvent *stages, const int *seen )
+{
+	int s;
+
+	printf( "-------------------------------------\n" );
+	printf( "Cycle: %llu\n", (unsigned long long) cycle );
+	for( s = 0; s < EV_NUM_STAGES; s++ )
+	{
+		printf( "%s\t", STAGE_NAMES[s] );
+		if( seen[s] )
+			print_event( &stages[s] );
+		else
+			printf( "-" );
+		printf( "\n" );
+	}
+}
+
+int main( int argc, char *argv[] )
+{
+	PipeEventHeader header;
+	PipeEvent *events, stages[EV_NUM_STAGES];
+	int seen[EV_NUM_STAGES] = { 0 };
+	int snapshots = FALSE, konata = FALSE;
+	uint64_t total = 0, cycles = 0, cycle = 0;
+	size_t n, i;
+	const char *path;
+	FILE *fp;
+
+	if( argc == 3 && strcmp( argv[1], "-p" ) == 0 )
+	{
+		snapshots = TRUE;
+		path = argv[2];
+	}
+	else if( argc == 3 && strcmp( argv[1], "-k" ) == 0 )
+	{
+		konata = TRUE;
+		path = argv[2];
+	}
+	else if( argc == 2 )
+	{
+		path = argv[1];
+	}
+	else
+	{
+		printf( "Usage: %s [-p | -k] <event file>\n", argv[0] );
+		return 1;
+	}
+
+	fp = fopen( path, "rb" );
+	if( fp == NULL )
+	{
+		printf( "Error: Can't open event file %s\n", path );
+		return 1;
+	}
+	if( fread( &header, sizeof( header ), 1, fp ) != 1 || memcmp( header.magic, EVENT_MAGIC, 4 ) != 0 )
+	{
+		printf( "Error: %s is not a pipeline event file\n", path );
+		return 1;
+	}
+	if( header.version != EVENT_VERSION || header.event_size != sizeof( PipeEvent ) )
+	{
+		printf( "Error: %s has version %u events of %u bytes, expected version %u of %u bytes\n",
+			path, header.version, header.event_size, EVENT_VERSION, (uint32_t) sizeof( PipeEvent ) );
+		return 1;
+	}
+
+	events = malloc( DUMP_CHUNK * sizeof( PipeEvent ) );
+	if( events == NULL )
+	{
+		printf( "Error: out of memory\n" );
+		return 1;
+	}
+
+	if( konata )
+	{
+		setvbuf( stdout, NULL, _IOFBF, PV_BUF_SIZE );
+		pipeview_begin( &PIPEVIEW, stdout );
+		while( ( n = fread( events, sizeof( PipeEvent ), DUMP_CHUNK, fp ) ) > 0 )
+		{
+			for( i = 0; i < n; i++ )
+				pipeview_event( &PIPEVIEW, &events[i] );
+		}
+		pipeview_end( &PIPEVIEW );
+		fclose( fp );
+		free( events );
+		return 0;
+	}
+
+	while( ( n = fread( events, sizeof( PipeEvent ), DUMP_CHUNK, fp ) ) > 0 )
+	{
+		for( i = 0; i < n; i++ )
+		{
+			const PipeEvent *e = &events[i];
+
+			if( e->stage >= EV_NUM_STAGES )
+			{
+				continue;
+			}
+			if( total == 0 || e->cycle != cycle )
+			{
+				if( snapshots && total != 0 )
+					print_snapshot( cycle, stages, seen );
+				memset( seen, 0, sizeof( seen ) );
+				cycle = e->cycle;
+				++cycles;
+			}
+			++total;
+			KIND_COUNT[e->kind & 3]++;
+			REASON_COUNT[e->reason & 3]++;
+			HITS += ( e->flags & EV_FLAG_HIT ) != 0;
+			MISSES += ( e->flags & EV_FLAG_MISS ) != 0;
+
+			if( snapshots )
+			{
+				stages[e->stage] = *e;
+				seen[e->stage] = TRUE;
+			}
+			else
+			{
+				printf( "%10llu  %-3s ", (unsigned long long) e->cycle, STAGE_NAMES[e->stage] );
+				print_event( e );
+				printf( "\n" );
+			}
+		}
+	}
+	if( snapshots && total != 0 )
+	{
+		print_snapshot( cycle, stages, seen );
+	}
+	fclose( fp );
+	free( events );
+
+	printf( "-------------------------------------\n" );
+	printf( "Events\t: %llu over %llu cycles\n", (unsigned long long) total, (unsigned long long) cycles );
+	printf( "Stalls\t: %llu (%llu hazard, %llu cache miss)\n",
+		(unsigned long long) KIND_COUNT[EV_STALL],
+		(unsigned long long) REASON_COUNT[EV_REASON_HAZARD],
+		(unsigned long long) REASON_COUNT[EV_REASON_CACHE] );
+	printf( "Bubbles\t: %llu\n", (unsigned long long) KIND_COUNT[EV_BUBBLE] );
+	printf( "Flushes\t: %llu\n", (unsigned long long) KIND_COUNT[EV_FLUSH] );
+	printf( "Cache\t: %llu hits, %llu misses\n", (unsigned long long) HITS, (unsigned long long) MISSES );
+	return 0;
+}
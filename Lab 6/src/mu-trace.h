@@ -0,0 +1,92 @@
+/******************************************************************************/
+/* PIPELINE TRACE                                                             */
+/******************************************************************************/
+/* Every message the pipeline stages print goes through TRACE(), tagged with  */
+/* a category and a level:                                                    */
+/*   TRACE_INFO  - one line per event: fetched instruction, stall, forward,   */
+/*                 taken branch, cache block written back                     */
+/*   TRACE_DEBUG - per-stage detail: operands read, EX handler names,         */
+/*                 running hit/miss counts                                    */
+/*                                                                            */
+/* TRACE_MASK[level] holds the categories enabled at that level, so a         */
+/* disabled message costs one load and one well-predicted branch. The        */
+/* `trace` command changes the mask at run time; by default everything is   */
+/* on, as the simulator always printed.                                      */
+/*                                                                            */
+/* Messages go to stdout, or to the background log of mu-log.h while one   */
+/* is open.                                                                 */
+/*                                                                            */
+/* `tfilter` narrows the trace, and the events of mu-event.h, to part of   */
+/* the run: PCs in a range, cycles in a window, or one in every N fetched   */
+/* instructions. IF decides once per instruction and the verdict rides in  */
+/* the pipeline latch (Filtered); the cycle window is checked once per      */
+/* cycle. Each stage then sets TRACE_PASS from its latch, so a filtered     */
+/* message costs the same as a disabled one.                                */
+/*                                                                            */
+/* Building with -DTRACE_MAX_LEVEL=0 (or a lower TRACE_BUILD_MASK) turns the  */
+/* test into a constant and the compiler drops those messages altogether.   */
+/******************************************************************************/
+#define TRACE_FETCH  0x01
+#define TRACE_DECODE 0x02
+#define TRACE_EXEC   0x04
+#define TRACE_MEM    0x08
+#define TRACE_CACHE  0x10
+#define TRACE_HAZARD 0x20
+#define TRACE_ALL    0x3F
+#define TRACE_NUM_CATS 6
+
+/* Levels */
+#define TRACE_OFF   0
+#define TRACE_INFO  1
+#define TRACE_DEBUG 2
+
+#ifndef TRACE_MAX_LEVEL
+#define TRACE_MAX_LEVEL TRACE_DEBUG //highest level compiled in
+#endif
+#ifndef TRACE_BUILD_MASK
+#define TRACE_BUILD_MASK TRACE_ALL //categories compiled in
+#endif
+
+#define TRACE_ON(cat, level) \
+	( (level) <= TRACE_MAX_LEVEL && ((cat) & TRACE_BUILD_MASK) && (TRACE_MASK[level] & (cat)) && TRACE_PASS )
+
+/* Called by each stage with the latch it works on */
+#define TRACE_STAGE(latch) \
+	( TRACE_PASS = !(latch).Filtered && TRACE_FILTER.in_window )
+
+typedef struct TraceFilter_Struct {
+
+  int select; //TRUE while a PC range or a sampling rate picks instructions
+  uint32_t pc_begin, pc_end; //trace PCs in [pc_begin..pc_end]
+  uint32_t sample; //trace one in every sample instructions fetched in range
+  uint32_t countdown; //in-range fetches to skip before the next traced one
+
+  int windowed; //TRUE while a cycle window is set
+  uint32_t cycle_begin, cycle_end; //trace cycles in [cycle_begin, cycle_end)
+  int in_window; //CYCLE_COUNT is inside the window, TRUE with no window
+
+} TraceFilter;
+
+#define TRACE(cat, level, ...) \
+	do { if ( TRACE_ON(cat, level) ) { if (LOG_ACTIVE) log_printf(__VA_ARGS__); else printf(__VA_ARGS__); } } while (0)
+
+
+/***************************************************************/
+/* TRACE SETTINGS                                              */
+/***************************************************************/
+uint32_t TRACE_MASK[TRACE_DEBUG + 1] = { 0, TRACE_ALL, TRACE_ALL }; //categories enabled at each level
+
+const char *TRACE_NAMES[TRACE_NUM_CATS] = { "fetch", "decode", "exec", "mem", "cache", "hazard" };
+
+TraceFilter TRACE_FILTER = { FALSE, 0, 0xFFFFFFFF, 1, 0, FALSE, 0, 0, TRUE };
+int TRACE_PASS = TRUE; //the instruction in the running stage passes TRACE_FILTER
+
+
+/***************************************************************/
+/* Function Declerations.                                      */
+/***************************************************************/
+void trace_set(uint32_t cats, int level);
+uint32_t trace_parse(char *names);
+void trace_report();
+void trace_filter_update();
+void trace_filter_report();